@@ -0,0 +1,46 @@
+﻿#include <cstdlib>
+#include <iostream>
+#include <exception>
+#include <string_view>
+#include <filesystem>
+
+#include <GraphLayout/Graph/NodeGraphBinary.hpp>
+
+using namespace usagi;
+
+/*
+ * Converts .ng text graphs to the memory-mapped .ngb format, so that large
+ * benchmark inputs skip parsing when they are loaded.
+ */
+int main(int argc, char *argv[])
+{
+    if(argc < 2 || argc > 3 ||
+        std::string_view(argv[1]) == "--help")
+    {
+        std::cerr << "Usage: " << argv[0] << " <input.ng> [output.ngb]\n"
+            "Converts a text node graph to the binary format. The output\n"
+            "defaults to the input path with the extension .ngb.\n";
+        return argc == 2 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    const std::filesystem::path input = argv[1];
+    auto output = argc == 3
+        ? std::filesystem::path(argv[2])
+        : std::filesystem::path(input).replace_extension(".ngb");
+    if(input.extension() == ".ngb")
+    {
+        std::cerr << input << " is already a binary node graph.\n";
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        node_graph::binary::convertToBinary(input, output);
+    }
+    catch(const std::exception &e)
+    {
+        std::cerr << "Conversion failed: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,378 @@
+﻿#include <cstdlib>
+#include <cstdint>
+#include <string>
+#include <set>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#include <GraphLayout/Core/Logging.hpp>
+#include <GraphLayout/Layout/PortGraphFitness.hpp>
+#include <GraphLayout/Layout/RandomizedTest.hpp>
+#include <GraphLayout/Graph/PointGraph.hpp>
+#include <GraphLayout/Spring/SimpleSpring.hpp>
+
+using namespace usagi;
+using namespace genetic;
+
+/*
+ * Times the stages of PortGraphFitness, the genetic operators and the
+ * spring layout on seeded random graphs. One CSV row is written per
+ * benchmark and graph size:
+ *
+ *     benchmark, nodes, links, iterations, ns_per_op, ns_min, ns_max
+ *
+ * ns_per_op is the median over the measured batches, ns_min and ns_max are
+ * the fastest and slowest batch, all per iteration.
+ */
+namespace
+{
+struct BenchmarkConfig
+{
+    std::vector<int> sizes { 10, 50, 100, 500, 1000, 5000 };
+    std::uint32_t seed = 1;
+    int population = 100;
+    int pin_amount = 5;
+    float connection_rate = 2;
+    float canvas_size_per_node = 250;
+    // approximate time spent on each benchmark, in seconds
+    double min_time = 0.5;
+    int batches = 10;
+    std::string filter;
+};
+
+struct Result
+{
+    std::uint64_t iterations = 0;
+    double median = 0, min = 0, max = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double runBatch(const std::function<void()> &func, const std::uint64_t n)
+{
+    const auto begin = Clock::now();
+    for(std::uint64_t i = 0; i < n; ++i)
+        func();
+    const std::chrono::duration<double, std::nano> time =
+        Clock::now() - begin;
+    return time.count();
+}
+
+Result measure(const BenchmarkConfig &config, const std::function<void()> &func)
+{
+    // warm up the caches and find a batch size filling the time slice
+    const double slice = config.min_time * 1e9 / config.batches;
+    std::uint64_t n = 1;
+    for(auto t = runBatch(func, n); t < slice; t = runBatch(func, n))
+    {
+        n = t <= 0 ? n * 10 : std::max<std::uint64_t>(
+            n + 1, std::min<std::uint64_t>(
+                n * 10, static_cast<std::uint64_t>(n * slice / t * 1.1)));
+    }
+
+    std::vector<double> samples(config.batches);
+    for(auto &&s : samples)
+        s = runBatch(func, n) / n;
+    std::sort(samples.begin(), samples.end());
+
+    return {
+        n * samples.size(),
+        samples[samples.size() / 2],
+        samples.front(),
+        samples.back()
+    };
+}
+
+struct Suite
+{
+    const BenchmarkConfig &config;
+    std::ostream &out;
+    std::size_t nodes = 0, links = 0;
+
+    void run(const std::string &name, const std::function<void()> &func)
+    {
+        if(name.find(config.filter) == std::string::npos)
+            return;
+        const auto r = measure(config, func);
+        out << fmt::format("{}, {}, {}, {}, {:.1f}, {:.1f}, {:.1f}",
+            name, nodes, links, r.iterations, r.median, r.min, r.max)
+            << std::endl;
+    }
+};
+
+void benchmarkGraph(
+    const BenchmarkConfig &config,
+    const int node_amount,
+    std::ostream &out)
+{
+    PortGraphOptimizer optimizer;
+    optimizer.rng.seed(config.seed);
+    auto &graph = optimizer.generator.prototype;
+    std::mt19937 graph_rng { config.seed + node_amount };
+    createTestNodes(graph, node_amount, config.pin_amount);
+    createRandomLinks(graph,
+        int(config.connection_rate * node_amount), graph_rng);
+
+    std::uniform_real_distribution<float> domain {
+        0.f, config.canvas_size_per_node * node_amount
+    };
+    optimizer.generator.domain = domain;
+    optimizer.mutation.domain = domain;
+    optimizer.initializePopulation(config.population);
+
+    Suite suite { config, out, graph.nodes.size(), graph.links.size() };
+    LOG(info, "Benchmarking {} nodes, {} links", suite.nodes, suite.links);
+
+    // fitness stages, each on the state left by the previous ones
+
+    PortGraphFitness fitness = optimizer.fitness;
+    PortGraphIndividual individual = optimizer.population.front();
+    individual.graph.node_positions = reinterpret_cast<Vector2f*>(
+        individual.genotype.data());
+
+    suite.run("fitness/full", [&]() {
+        fitness.evaluate(individual, false);
+    });
+    // an offspring below the best individual, given up once that is known
+    {
+        const auto bound = optimizer.best.top()->fitness + 1;
+        suite.run("fitness/bounded", [&]() {
+            fitness.evaluate(individual, false, bound);
+        });
+    }
+    suite.run("fitness/prepare", [&]() {
+        fitness.prepareTerms(individual);
+    });
+    suite.run("fitness/overlap", [&]() {
+        individual.cache.overlaps = fitness.countOverlaps(individual);
+    });
+    suite.run("fitness/angle_position", [&]() {
+        fitness.measureLinks(individual);
+    });
+    suite.run("fitness/routing_heuristic", [&]() {
+        fitness.routeLinks(individual);
+    });
+    suite.run("fitness/edge_crossings", [&]() {
+        individual.cache.edge_crossings = fitness.countEdgeCrossings();
+    });
+    suite.run("fitness/sum", [&]() {
+        fitness.sumTerms(individual);
+    });
+    fitness.heuristic = false;
+    suite.run("fitness/routing_fixed", [&]() {
+        fitness.routeLinks(individual);
+    });
+    fitness.heuristic = true;
+
+    // incremental evaluation of an offspring with one node moved
+    {
+        PortGraphIndividual offspring;
+        std::mt19937 rng { config.seed };
+        std::uniform_int_distribution<std::size_t> gene_dist {
+            0, individual.genotype.size() - 1
+        };
+        fitness.evaluate(individual, false);
+        suite.run("fitness/incremental", [&]() {
+            fitness.inherit(offspring, individual);
+            offspring.genotype[gene_dist(rng)] = domain(rng);
+            fitness.evaluate(offspring, true);
+        });
+    }
+
+    // genetic operators
+
+    suite.run("parent/tournament", [&]() {
+        optimizer.parent_selection(optimizer);
+    });
+    {
+        replacement::RoundRobinTournamentReplacement<10, 2> replacement;
+        suite.run("replacement/round_robin_tournament", [&]() {
+            replacement(optimizer);
+        });
+    }
+
+    auto a = optimizer.population[0].genotype;
+    auto b = optimizer.population[1].genotype;
+    auto &rng = optimizer.rng;
+    {
+        crossover::OnePointCrossover crossover;
+        suite.run("crossover/one_point", [&]() {
+            crossover(a, b, rng);
+        });
+    }
+    {
+        crossover::WholeArithmeticRecombination crossover;
+        suite.run("crossover/whole_arithmetic", [&]() {
+            crossover(a, b, rng);
+        });
+    }
+    {
+        mutation::GaussianMutation<std::vector<float>> mutation;
+        suite.run("mutation/gaussian", [&]() {
+            mutation(a, rng);
+        });
+    }
+    {
+        mutation::UniformIntMutation<std::vector<float>> mutation;
+        suite.run("mutation/uniform_int", [&]() {
+            mutation(a, rng);
+        });
+    }
+    {
+        mutation::UniformRealMutation<std::vector<float>> mutation;
+        mutation.domain = domain;
+        suite.run("mutation/uniform_real", [&]() {
+            mutation(a, rng);
+        });
+    }
+}
+
+void benchmarkSpring(
+    const BenchmarkConfig &config,
+    const int node_amount,
+    std::ostream &out)
+{
+    using Graph = PointGraph<Vector3f>;
+    Graph graph;
+    std::mt19937 rng { config.seed + node_amount };
+    std::uniform_real_distribution<float> domain { -5, 5 };
+    for(int i = 0; i < node_amount; ++i)
+        graph.addVertex({ domain(rng), domain(rng), domain(rng) });
+    std::uniform_int_distribution<std::uint32_t> vertex {
+        0, static_cast<std::uint32_t>(node_amount - 1)
+    };
+    // draw until the requested amount of distinct edges is reached
+    const auto edge_amount = std::min<std::size_t>(
+        static_cast<std::size_t>(config.connection_rate * node_amount),
+        std::size_t(node_amount) * (node_amount - 1) / 2);
+    std::set<Graph::EdgeT> drawn;
+    while(drawn.size() < edge_amount)
+    {
+        const auto a = vertex(rng), b = vertex(rng);
+        if(a != b && drawn.emplace(std::min(a, b), std::max(a, b)).second)
+            graph.addEdge(a, b);
+    }
+
+    Suite suite { config, out, graph.positions.size(), graph.edges.size() };
+    LOG(info, "Benchmarking spring layout on {} vertices, {} edges",
+        suite.nodes, suite.links);
+
+    // each iteration starts from the same layout
+    const auto initial = graph.positions;
+    SimpleSpring<Graph>::Parameters param;
+    SimpleSpring<Graph> spring { &graph, &param };
+    suite.run("spring/exact", [&]() {
+        graph.positions = initial;
+        spring.update();
+    });
+    param.barnes_hut = true;
+    suite.run("spring/barnes_hut", [&]() {
+        graph.positions = initial;
+        spring.update();
+    });
+}
+
+std::vector<int> parseSizes(const std::string &list)
+{
+    std::vector<int> sizes;
+    std::size_t begin = 0;
+    while(begin < list.size())
+    {
+        auto end = list.find(',', begin);
+        if(end == std::string::npos) end = list.size();
+        sizes.push_back(std::atoi(list.substr(begin, end - begin).c_str()));
+        begin = end + 1;
+    }
+    return sizes;
+}
+
+void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+        "Times the fitness stages and genetic operators, writing CSV rows.\n"
+        "  --sizes <n,n,...>        node amounts of the random graphs\n"
+        "  --seed <n>               seed of the graphs and populations\n"
+        "  --population <n>         population size\n"
+        "  --ports <n>              input and output ports per node\n"
+        "  --connection-rate <f>    links per node\n"
+        "  --canvas-per-node <f>    canvas size per node\n"
+        "  --min-time <f>           seconds spent on each benchmark\n"
+        "  --batches <n>            measured batches per benchmark\n"
+        "  --filter <text>          only run benchmarks containing text\n"
+        "  --output <file>          write to file instead of stdout\n";
+}
+}
+
+int main(int argc, char *argv[])
+{
+    BenchmarkConfig config;
+    std::string output;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const auto value = [&]() -> const char * {
+            if(i + 1 >= argc)
+            {
+                std::cerr << "Missing value for " << arg << "\n";
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+
+        if(arg == "--sizes") config.sizes = parseSizes(value());
+        else if(arg == "--seed")
+            config.seed = static_cast<std::uint32_t>(std::atoll(value()));
+        else if(arg == "--population") config.population = std::atoi(value());
+        else if(arg == "--ports") config.pin_amount = std::atoi(value());
+        else if(arg == "--connection-rate")
+            config.connection_rate = static_cast<float>(std::atof(value()));
+        else if(arg == "--canvas-per-node")
+            config.canvas_size_per_node =
+                static_cast<float>(std::atof(value()));
+        else if(arg == "--min-time") config.min_time = std::atof(value());
+        else if(arg == "--batches") config.batches = std::atoi(value());
+        else if(arg == "--filter") config.filter = value();
+        else if(arg == "--output") output = value();
+        else
+        {
+            printUsage(argv[0]);
+            return arg == "--help" ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if(config.sizes.empty() || config.population < 10 ||
+        config.pin_amount < 1 || config.batches < 1 ||
+        std::any_of(config.sizes.begin(), config.sizes.end(),
+            [](int n) { return n < 2; }))
+    {
+        std::cerr << "Invalid benchmark configuration.\n";
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream file;
+    if(!output.empty())
+    {
+        file.open(output);
+        if(!file)
+        {
+            std::cerr << "Failed to open " << output << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    std::ostream &out = output.empty() ? std::cout : file;
+
+    out << "benchmark, nodes, links, iterations, ns_per_op, ns_min, ns_max"
+        << std::endl;
+    for(auto &&n : config.sizes)
+    {
+        benchmarkGraph(config, n, out);
+        benchmarkSpring(config, n, out);
+    }
+    return EXIT_SUCCESS;
+}
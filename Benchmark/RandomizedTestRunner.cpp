@@ -0,0 +1,130 @@
+﻿#include <cstdlib>
+#include <cstdint>
+#include <csignal>
+#include <atomic>
+#include <ctime>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include <filesystem>
+
+#include <GraphLayout/Core/Logging.hpp>
+#include <GraphLayout/Layout/RandomizedTest.hpp>
+
+using namespace usagi;
+
+namespace
+{
+std::atomic<bool> gContinue { true };
+
+// stop the campaign on ctrl-c. the running optimizations are saved so that
+// the next run on the same folder resumes them.
+extern "C" void handleInterrupt(int)
+{
+    gContinue = false;
+}
+
+void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+        "Runs randomized layout tests and writes test_<nodes>.csv files.\n"
+        "  --start <n>              first node amount\n"
+        "  --finish <n>             last node amount\n"
+        "  --step <n>               node amount increment\n"
+        "  --graphs <n>             random graphs per node amount\n"
+        "  --repeat <n>             optimizations per graph\n"
+        "  --population <n>         population size\n"
+        "  --canvas-per-node <f>    canvas size per node\n"
+        "  --ports <n>              input and output ports per node\n"
+        "  --connection-rate <f>    links per node\n"
+        "  --batch <n>              offspring pairs per step\n"
+        "  --islands <n>            populations evolved in parallel\n"
+        "  --migration-interval <n> years between migrations\n"
+        "  --migration-size <n>     migrants per migration\n"
+        "  --fully-connected        migrate to all other islands\n"
+        "  --no-heuristic           disable the routing heuristic\n"
+        "  --no-bound               evaluate every offspring completely\n"
+        "  --seeded-fraction <f>    initial individuals from a force layout,\n"
+        "                           0 by default, e.g. 0.5 for large graphs\n"
+        "  --stop-threshold <f>     significant improvement threshold\n"
+        "  --stop-period <n>        significant improvement period\n"
+        "  --seed <n>               seed of the graphs and optimizations\n"
+        "  --checkpoint <f>         seconds between checkpoints\n"
+        "  --output <dir>           output folder, tests/<time> by default.\n"
+        "                           an existing folder resumes its campaign\n";
+}
+}
+
+int main(int argc, char *argv[])
+{
+    RandomTestConfig config;
+    std::filesystem::path folder =
+        "tests/" + std::to_string(std::time(nullptr));
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        const auto value = [&]() -> const char * {
+            if(i + 1 >= argc)
+            {
+                std::cerr << "Missing value for " << arg << "\n";
+                std::exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+        const auto integer = [&]() { return std::atoi(value()); };
+        const auto real = [&]() { return static_cast<float>(
+            std::atof(value())); };
+
+        if(arg == "--start") config.start_node_amount = integer();
+        else if(arg == "--finish") config.finish_node_amount = integer();
+        else if(arg == "--step") config.step = integer();
+        else if(arg == "--graphs") config.generation = integer();
+        else if(arg == "--repeat") config.repeat = integer();
+        else if(arg == "--population") config.population = integer();
+        else if(arg == "--canvas-per-node")
+            config.canvas_size_per_node = real();
+        else if(arg == "--ports") config.pin_amount = integer();
+        else if(arg == "--connection-rate")
+            config.pin_connection_rate = real();
+        else if(arg == "--batch") config.batch_size = integer();
+        else if(arg == "--islands") config.islands = integer();
+        else if(arg == "--migration-interval")
+            config.migration_interval = integer();
+        else if(arg == "--migration-size") config.migration_size = integer();
+        else if(arg == "--fully-connected")
+            config.fully_connected_migration = true;
+        else if(arg == "--no-heuristic") config.heuristic = false;
+        else if(arg == "--no-bound") config.bounded_evaluation = false;
+        else if(arg == "--seeded-fraction") config.seeded_fraction = real();
+        else if(arg == "--stop-threshold")
+            config.stop.significant_improvement_threshold = real();
+        else if(arg == "--stop-period")
+            config.stop.significant_improvement_period = integer();
+        else if(arg == "--seed")
+            config.seed = static_cast<std::uint32_t>(std::atoll(value()));
+        else if(arg == "--checkpoint")
+            config.checkpoint_interval =
+                static_cast<float>(std::atof(value()));
+        else if(arg == "--output") folder = value();
+        else
+        {
+            printUsage(argv[0]);
+            return arg == "--help" ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if(config.start_node_amount < 1 || config.step < 1 ||
+        config.finish_node_amount < config.start_node_amount ||
+        config.population < 4 || config.pin_amount < 1)
+    {
+        std::cerr << "Invalid test configuration.\n";
+        return EXIT_FAILURE;
+    }
+
+    create_directories(folder);
+    LOG(info, "Writing results to {}", folder);
+    std::signal(SIGINT, handleInterrupt);
+    performRandomizedTests(config, folder, []() { return gContinue.load(); });
+    return EXIT_SUCCESS;
+}
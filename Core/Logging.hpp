@@ -0,0 +1,40 @@
+﻿#pragma once
+
+/**
+ * Logging and string formatting used by the layout core. Headless builds
+ * (GRAPHLAYOUT_HEADLESS) write the log to stderr instead of the Usagi
+ * engine logger.
+ */
+
+#ifdef GRAPHLAYOUT_HEADLESS
+
+#include <string>
+#include <cstdio>
+
+#include <fmt/format.h>
+#include <fmt/ostream.h>
+#include <fmt/std.h>
+
+namespace usagi
+{
+using fmt::format;
+
+namespace detail
+{
+inline void log(const char *level, const std::string &message)
+{
+    // a single call keeps lines from different threads apart
+    std::fprintf(stderr, "[%s] %s\n", level, message.c_str());
+}
+}
+}
+
+#define LOG(level, ...) \
+    ::usagi::detail::log(#level, ::fmt::format(__VA_ARGS__))
+
+#else
+
+#include <Usagi/Core/Format.hpp>
+#include <Usagi/Core/Logging.hpp>
+
+#endif
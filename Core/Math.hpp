@@ -0,0 +1,40 @@
+﻿#pragma once
+
+/**
+ * Math types used by the layout core. Headless builds (GRAPHLAYOUT_HEADLESS)
+ * take them from Eigen directly instead of the Usagi engine, which defines
+ * them the same way.
+ */
+
+#ifdef GRAPHLAYOUT_HEADLESS
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+namespace usagi
+{
+using Vector2f = Eigen::Vector2f;
+using Vector3f = Eigen::Vector3f;
+using AlignedBox2f = Eigen::AlignedBox2f;
+
+template <typename T>
+T lerp(const float t, const T &a, const T &b)
+{
+    return a + (b - a) * t;
+}
+
+template <typename T>
+T radiansToDegrees(const T radians)
+{
+    return radians * static_cast<T>(57.295779513082320876798154814105);
+}
+}
+
+#else
+
+#include <Usagi/Math/Matrix.hpp>
+#include <Usagi/Math/Bound.hpp>
+#include <Usagi/Math/Lerp.hpp>
+#include <Usagi/Math/Angle.hpp>
+
+#endif
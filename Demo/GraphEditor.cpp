@@ -24,15 +24,33 @@ void usagi::GraphEditor::drawEditor(const Clock &clock)
         {
             mLayout.update();
         }
-
-        DragFloat("c1 (spring constant)", &mParameters.c1,
+        auto &cooling = mLayout.cooling;
+        Text("Iteration %u: energy %.4g, max displacement %.4g%s",
+            cooling.iteration, cooling.energy, cooling.max_displacement,
+            cooling.converged ? " (converged)" : "");
+
+        // parameter changes heat the layout up again
+        bool changed = false;
+        changed |= DragFloat("c1 (spring constant)", &mParameters.c1,
             0.1f, 0.1f, 1000.f);
-        DragFloat("c2 (original spring length)", &mParameters.c2,
+        changed |= DragFloat("c2 (original spring length)", &mParameters.c2,
             0.1f, 0.1f, 1000.f);
-        DragFloat("c3 (repel factor)", &mParameters.c3,
+        changed |= DragFloat("c3 (repel factor)", &mParameters.c3,
             0.1f, 0.1f, 1000.f);
-        DragFloat("c4 (update rate)", &mParameters.c4,
+        changed |= DragFloat("c4 (update rate)", &mParameters.c4,
             0.1f, 0.1f, 1000.f);
+        changed |= Checkbox("Barnes-Hut Repulsion",
+            &mParameters.barnes_hut);
+        changed |= SliderFloat("Theta (opening angle)",
+            &mParameters.theta, 0, 2);
+        changed |= Checkbox("Adaptive Cooling",
+            &mParameters.adaptive_cooling);
+        changed |= SliderFloat("Annealing", &mParameters.annealing,
+            0.9f, 1.f);
+        changed |= DragFloat("Tolerance", &mParameters.tolerance,
+            0.001f, 0.f, 1.f);
+        if(Button("Restart Cooling") || changed)
+            mLayout.restart();
 
         DragFloat("Edge Connect Possibility", &mEdgeConnectP,
             0.01f, 0, 1);
@@ -41,7 +59,7 @@ void usagi::GraphEditor::drawEditor(const Clock &clock)
     }
     End();
 
-    if(mUpdate)
+    if(mUpdate && !mLayout.converged())
         mLayout.update();
 }
 
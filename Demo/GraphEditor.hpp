@@ -7,20 +7,17 @@
 #include <Usagi/Extension/DebugDraw/DebugDrawComponent.hpp>
 #include <Usagi/Interactive/InputComponent.hpp>
 
+#include <GraphLayout/Graph/DenseProperty.hpp>
 #include <GraphLayout/Spring/SimpleSpring.hpp>
 #include <GraphLayoutDemo/ElementGraph/ElementBasedPointGraph.hpp>
 
 namespace usagi
 {
+// forces are indexed by vertex ordinal, SimpleSpring sizes the storage
 template <>
 struct ElementBasedPointGraph::Traits::property_accessor<ForcePropertyTag>
+    : DenseVertexProperty<Vector3f>
 {
-    std::unordered_map<Element*, Vector3f> forces;
-
-    auto & operator()(vertex_iterator_t i)
-    {
-        return forces[i->get()];
-    }
 };
 
 class GraphEditor
@@ -1,23 +1,43 @@
 ﻿#pragma once
 
 #include <vector>
+#include <queue>
+#include <utility>
+#include <cassert>
 
 namespace usagi
 {
+/**
+ * \brief Default position tracker of BinaryHeap. Accesses queue_index of
+ * the pointed structure.
+ */
+struct QueueIndexMember
+{
+    template <typename T>
+    std::size_t & operator()(T element) const
+    {
+        return element->queue_index;
+    }
+};
+
 /**
  * \brief With Comparator == less, this maintains the smallest element at the
  * top.
  * \tparam T Supposed to be a pointer to external structure.
  * \tparam Comparator Use < for min heap, > for max heap.
+ * \tparam IndexMember Returns a reference to the position of an element in
+ * the heap. Use different ones to put the same element in multiple heaps.
  */
 template <
     typename T,
-    typename Comparator
+    typename Comparator,
+    typename IndexMember = QueueIndexMember
 >
 class BinaryHeap
 {
     std::vector<T> mHeap;
     Comparator mComparator;
+    IndexMember mIndex;
 
     static constexpr std::size_t parent(const std::size_t node_idx)
     {
@@ -38,8 +58,8 @@ class BinaryHeap
     {
         std::swap(mHeap[a], mHeap[b]);
         // maintain correct references from tiles to queue
-        mHeap[a]->queue_index = a;
-        mHeap[b]->queue_index = b;
+        mIndex(mHeap[a]) = a;
+        mIndex(mHeap[b]) = b;
     }
 
     void bubble(const std::size_t index)
@@ -111,7 +131,7 @@ public:
     {
         std::size_t new_elem_pos = mHeap.size();
         mHeap.push_back(element);
-        mHeap.back()->queue_index = new_elem_pos;
+        mIndex(mHeap.back()) = new_elem_pos;
         bubble(new_elem_pos);
     }
 
@@ -121,20 +141,46 @@ public:
         return mHeap[0];
     }
 
+    /**
+     * \brief Output the first count elements in heap order without modifying
+     * the heap. Takes O(count log count) time.
+     */
+    template <typename OutputIt>
+    void top(const std::size_t count, OutputIt out)
+    {
+        assert(count <= mHeap.size());
+        if(count == 0) return;
+        // frontier of the visited subtree, ordered by the same comparator
+        const auto cmp = [this](std::size_t a, std::size_t b) {
+            return mComparator(mHeap[b], mHeap[a]);
+        };
+        std::priority_queue<std::size_t, std::vector<std::size_t>,
+            decltype(cmp)> frontier { cmp };
+        frontier.push(0);
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            const auto idx = frontier.top();
+            frontier.pop();
+            *out++ = mHeap[idx];
+            if(leftChild(idx) < size()) frontier.push(leftChild(idx));
+            if(rightChild(idx) < size()) frontier.push(rightChild(idx));
+        }
+    }
+
     T pop()
     {
         assert(!mHeap.empty());
 
         // prepare the element to be returned
         auto ret = std::move(top());
-        ret->queue_index = INVALID_INDEX;
+        mIndex(ret) = INVALID_INDEX;
 
         // we have more than one elements before pop
         if(size() > 1)
         {
             // move last to first
             mHeap.front() = std::move(mHeap.back());
-            mHeap.front()->queue_index = 0;
+            mIndex(mHeap.front()) = 0;
             sink(0);
         }
         mHeap.pop_back();
@@ -142,6 +188,22 @@ public:
         return std::move(ret);
     }
 
+    /**
+     * \brief Whether the heap order holds and every element knows its
+     * position. Takes linear time, meant for tests and assertions.
+     */
+    bool valid() const
+    {
+        for(std::size_t i = 0; i < mHeap.size(); ++i)
+        {
+            if(mIndex(mHeap[i]) != i)
+                return false;
+            if(i > 0 && mComparator(mHeap[i], mHeap[parent(i)]))
+                return false;
+        }
+        return true;
+    }
+
     void modifyKey(const std::size_t index)
     {
         // recover proper order. if the element is smaller than its parent
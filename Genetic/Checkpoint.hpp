@@ -0,0 +1,185 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Binary snapshots of a GeneticOptimizer, used to resume long optimizations.
+ * A snapshot holds the year, the fitness history, the state of the random
+ * engine and the genes and ancestry of each individual. The fitness and
+ * whatever the fitness function caches in the individuals are not stored,
+ * they are recomputed when the snapshot is read. Values are written in the
+ * byte order of the machine.
+ */
+namespace usagi::genetic::checkpoint
+{
+template <typename T>
+void writeValue(std::ostream &out, const T &value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void readValue(std::istream &in, T &value)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    if(!in.read(reinterpret_cast<char*>(&value), sizeof(T)))
+        throw std::runtime_error("Truncated checkpoint");
+}
+
+template <typename T>
+T readValue(std::istream &in)
+{
+    T value;
+    readValue(in, value);
+    return value;
+}
+
+template <typename T>
+void writeArray(std::ostream &out, const T *data, const std::size_t size)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    writeValue(out, static_cast<std::uint64_t>(size));
+    out.write(reinterpret_cast<const char*>(data), size * sizeof(T));
+}
+
+/**
+ * \brief Read an array written by writeArray() into data, which must have
+ * room for exactly size elements.
+ */
+template <typename T>
+void readArray(std::istream &in, T *data, const std::size_t size)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    if(readValue<std::uint64_t>(in) != size)
+        throw std::runtime_error("Checkpoint array size mismatch");
+    if(!in.read(reinterpret_cast<char*>(data), size * sizeof(T)))
+        throw std::runtime_error("Truncated checkpoint");
+}
+
+template <typename T>
+void readVector(std::istream &in, std::vector<T> &values)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+    values.resize(static_cast<std::size_t>(readValue<std::uint64_t>(in)));
+    if(!in.read(reinterpret_cast<char*>(values.data()),
+        values.size() * sizeof(T)))
+        throw std::runtime_error("Truncated checkpoint");
+}
+
+/**
+ * \brief Standard random engines only expose their state through streams.
+ */
+template <typename Rng>
+void writeRng(std::ostream &out, const Rng &rng)
+{
+    std::ostringstream state;
+    state << rng;
+    const auto text = state.str();
+    writeArray(out, text.data(), text.size());
+}
+
+template <typename Rng>
+void readRng(std::istream &in, Rng &rng)
+{
+    std::string text(static_cast<std::size_t>(
+        readValue<std::uint64_t>(in)), '\0');
+    if(!in.read(text.data(), text.size()))
+        throw std::runtime_error("Truncated checkpoint");
+    std::istringstream state { text };
+    if(!(state >> rng))
+        throw std::runtime_error("Invalid random engine state in checkpoint");
+}
+
+namespace detail
+{
+/**
+ * \brief Detects population generators that can create an individual of the
+ * right size without filling in its genes.
+ */
+template <typename Generator, typename = void>
+struct HasCreateEmpty : std::false_type
+{
+};
+
+template <typename Generator>
+struct HasCreateEmpty<Generator, std::void_t<
+    decltype(std::declval<Generator&>().createEmpty())
+>> : std::true_type
+{
+};
+}
+
+/**
+ * \brief Write the optimizer state. The genotype must be a contiguous
+ * container of trivially copyable genes.
+ */
+template <typename Optimizer>
+void writeOptimizer(std::ostream &out, const Optimizer &o)
+{
+    writeValue(out, o.year);
+    writeValue(out, o.last_best_fitness);
+    writeArray(out, o.fitness_history.data(), o.fitness_history.size());
+    writeRng(out, o.rng);
+    writeValue(out, static_cast<std::uint64_t>(o.population.size()));
+    for(auto &&individual : o.population)
+    {
+        writeValue(out, individual.birthday);
+        writeValue(out, individual.generation);
+        writeValue(out, individual.family);
+        writeArray(out,
+            individual.genotype.data(), individual.genotype.size());
+    }
+}
+
+/**
+ * \brief Restore the state written by writeOptimizer() into an optimizer
+ * configured like the one that was saved. Each individual is created by the
+ * population generator of o before its genes are overwritten, so it has the
+ * same size and whatever else the generator sets up. Generators providing
+ * createEmpty() are asked for that instead, so that no genes are generated
+ * only to be overwritten. The population is then re-evaluated. Throws std::runtime_error if the snapshot does not fit o.
+ */
+template <typename Optimizer>
+void readOptimizer(std::istream &in, Optimizer &o)
+{
+    std::decay_t<decltype(o.year)> year;
+    readValue(in, year);
+    readValue(in, o.last_best_fitness);
+    readVector(in, o.fitness_history);
+    // the generator draws from o.rng, restore it afterwards
+    auto rng = o.rng;
+    readRng(in, rng);
+
+    const auto size = static_cast<std::size_t>(
+        readValue<std::uint64_t>(in));
+    typename Optimizer::PopulationT population;
+    population.reserve(size);
+    for(std::size_t i = 0; i < size; ++i)
+    {
+        auto &individual = [&]() -> auto & {
+            if constexpr(detail::HasCreateEmpty<
+                decltype(o.generator)>::value)
+                return population.emplace_back(o.generator.createEmpty());
+            else
+                return population.emplace_back(o.generator(o));
+        }();
+        readValue(in, individual.birthday);
+        readValue(in, individual.generation);
+        readValue(in, individual.family);
+        readArray(in,
+            individual.genotype.data(), individual.genotype.size());
+    }
+    o.rng = rng;
+    o.year = year;
+    o.adoptPopulation(std::move(population));
+}
+}
@@ -2,9 +2,16 @@
 
 #include <vector>
 #include <random>
+#include <type_traits>
+#include <algorithm>
+#include <numeric>
+#include <execution>
+#include <thread>
+#include <limits>
+#include <cassert>
 
 #include "BinaryHeap.hpp"
-#include <Usagi/Core/Logging.hpp>
+#include <GraphLayout/Core/Logging.hpp>
 
 namespace usagi::genetic
 {
@@ -16,15 +23,117 @@ struct Individual
 
     std::uint32_t family = 0;
     std::uint32_t index = -1;
+    // positions in the best, worst and oldest heaps of the optimizer
     std::size_t queue_index = -1;
+    std::size_t worst_queue_index = -1;
+    std::size_t age_queue_index = -1;
 
     // generator provides genotype
     Genotype genotype;
     Fitness fitness { };
+    // the evaluation was stopped early and fitness is only an upper bound
+    bool partial = false;
 
     // todo use trait functions -> genotype() -> auto &
 };
 
+namespace detail
+{
+/**
+ * \brief Detects fitness functions providing
+ * inherit(Individual &offspring, const Individual &parent), which copies
+ * the genes along with whatever the fitness function cached in the
+ * individual.
+ */
+template <typename FitnessFunction, typename Individual, typename = void>
+struct HasInherit : std::false_type
+{
+};
+
+template <typename FitnessFunction, typename Individual>
+struct HasInherit<FitnessFunction, Individual, std::void_t<
+    decltype(std::declval<FitnessFunction&>().inherit(
+        std::declval<Individual&>(), std::declval<const Individual&>()))
+>> : std::true_type
+{
+};
+
+/**
+ * \brief Detects fitness functions providing statistics(), which returns a
+ * reference to a default-constructible value supporting +=. The statistics
+ * are reset by initializePopulation() and those gathered by the worker
+ * copies are summed into the fitness function of the optimizer.
+ */
+template <typename FitnessFunction, typename = void>
+struct HasStatistics : std::false_type
+{
+};
+
+template <typename FitnessFunction>
+struct HasStatistics<FitnessFunction, std::void_t<
+    decltype(std::declval<FitnessFunction&>().statistics() +=
+        std::declval<FitnessFunction&>().statistics())
+>> : std::true_type
+{
+};
+
+/**
+ * \brief Detects fitness functions providing
+ * fitness(Individual &individual, Fitness bound), which may stop evaluating
+ * once the fitness is known to be below bound and return an upper bound
+ * of it instead.
+ */
+template <typename FitnessFunction, typename Individual, typename = void>
+struct HasBoundedEvaluation : std::false_type
+{
+};
+
+template <typename FitnessFunction, typename Individual>
+struct HasBoundedEvaluation<FitnessFunction, Individual, std::void_t<
+    decltype(std::declval<FitnessFunction&>()(
+        std::declval<Individual&>(),
+        std::declval<typename FitnessFunction::FitnessT>()))
+>> : std::true_type
+{
+};
+
+/**
+ * \brief Detects fitness functions deriving from a ParametersT holding all
+ * of their settings. Only those are copied to the workers of parallel
+ * passes, which keep their own workspaces.
+ */
+template <typename FitnessFunction, typename = void>
+struct HasParameters : std::false_type
+{
+};
+
+template <typename FitnessFunction>
+struct HasParameters<FitnessFunction, std::void_t<
+    typename FitnessFunction::ParametersT
+>> : std::is_base_of<typename FitnessFunction::ParametersT, FitnessFunction>
+{
+};
+
+/**
+ * \brief Detects replacement strategies caching the ranks of individuals,
+ * which provide invalidate(std::size_t index) to be told about fitness
+ * changes made outside a replacement, and invalidate() to drop everything.
+ */
+template <typename ReplacementStrategy, typename = void>
+struct HasRankInvalidation : std::false_type
+{
+};
+
+template <typename ReplacementStrategy>
+struct HasRankInvalidation<ReplacementStrategy, std::void_t<
+    decltype(std::declval<ReplacementStrategy&>().invalidate(
+        std::declval<std::size_t>())),
+    decltype(std::declval<ReplacementStrategy&>().invalidate())
+>> : std::true_type
+{
+};
+}
+
 // https://www.tutorialspoint.com/genetic_algorithms/index.htm
 template <
     typename Gene,
@@ -72,6 +181,13 @@ struct GeneticOptimizer
     std::size_t population_size = 100;
     std::uint32_t year = 0;
     double crossover_rate = 0.85;
+    // # of offspring pairs produced by each step. when greater than one,
+    // the offspring are produced and evaluated in parallel, which requires
+    // the replacement strategy to choose multiple individuals at once.
+    std::size_t batch_size = 1;
+    // let the fitness function give up on offspring that can't beat the
+    // worst individual, which they are going to replace anyway
+    bool bounded_evaluation = true;
 
     // elite tracking
 
@@ -88,6 +204,44 @@ struct GeneticOptimizer
 
     BinaryHeap<Individual*, FitnessComparator> best;
 
+    // together with best, gives O(1) access to both ends of the fitness
+    // order and to the oldest individual for the replacement strategies.
+
+    struct WorstComparator
+    {
+        bool operator()(Individual *a, Individual *b) const
+        {
+            return a->fitness < b->fitness;
+        }
+    };
+
+    struct WorstIndex
+    {
+        std::size_t & operator()(Individual *i) const
+        {
+            return i->worst_queue_index;
+        }
+    };
+
+    struct AgeComparator
+    {
+        bool operator()(Individual *a, Individual *b) const
+        {
+            return a->birthday < b->birthday;
+        }
+    };
+
+    struct AgeIndex
+    {
+        std::size_t & operator()(Individual *i) const
+        {
+            return i->age_queue_index;
+        }
+    };
+
+    BinaryHeap<Individual*, WorstComparator, WorstIndex> worst;
+    BinaryHeap<Individual*, AgeComparator, AgeIndex> oldest;
+
     // fitness history
 
     struct FitnessHistory
@@ -110,18 +264,145 @@ struct GeneticOptimizer
         return std::forward_as_tuple(population[i0], population[i1]);
     }
 
-    void newIndividual(Individual &individual)
+    // parallel evaluation
+
+    /**
+     * \brief Private copies of the stateful operators for each thread. They
+     * are kept across passes, so the workspaces of the fitness functions
+     * are only allocated once.
+     */
+    struct Worker
+    {
+        FitnessFunctionT fitness;
+        CrossoverOperatorT crossover;
+        MutationOperatorT mutation;
+    };
+    std::vector<Worker> workers;
+
+    std::vector<std::size_t> batch_parents;
+    std::vector<std::size_t> batch_replaced;
+    std::vector<std::uint8_t> batch_replaced_marks;
+    std::vector<typename RngT::result_type> batch_seeds;
+    // fitness of the offspring, kept out of the individuals until they are
+    // merged so that the heaps never hold more than one stale key
+    std::vector<FitnessT> batch_fitness;
+
+    /**
+     * \brief Split [0, count) into one chunk per hardware thread and invoke
+     * func(worker, begin, end) for each chunk in parallel.
+     */
+    template <typename Func>
+    void parallelForChunks(const std::size_t count, Func &&func)
+    {
+        const std::size_t threads = std::clamp<std::size_t>(
+            std::thread::hardware_concurrency(), 1, std::max<std::size_t>(
+                count, 1));
+        if(workers.size() != threads)
+            workers.assign(threads, { fitness, crossover, mutation });
+        constexpr bool statistics =
+            detail::HasStatistics<FitnessFunctionT>::value;
+        for(auto &&w : workers)
+        {
+            // pick up the latest parameters
+            if constexpr(detail::HasParameters<FitnessFunctionT>::value)
+            {
+                using ParametersT = typename FitnessFunctionT::ParametersT;
+                static_cast<ParametersT &>(w.fitness) = fitness;
+            }
+            else
+            {
+                w.fitness = fitness;
+            }
+            w.crossover = crossover;
+            w.mutation = mutation;
+            if constexpr(statistics)
+                w.fitness.statistics() = { };
+        }
+        std::vector<std::size_t> chunks(threads);
+        std::iota(chunks.begin(), chunks.end(), 0);
+        std::for_each(
+            std::execution::par,
+            chunks.begin(), chunks.end(),
+            [&](const std::size_t c) {
+                func(workers[c], count * c / threads,
+                    count * (c + 1) / threads);
+            });
+        if constexpr(statistics)
+        {
+            for(auto &&w : workers)
+                fitness.statistics() += w.fitness.statistics();
+        }
+    }
+
+    static void inherit(
+        FitnessFunctionT &fitness,
+        Individual &offspring,
+        const Individual &parent)
+    {
+        if constexpr(detail::HasInherit<FitnessFunctionT, Individual>::value)
+            fitness.inherit(offspring, parent);
+        else
+            offspring.genotype = parent.genotype;
+    }
+
+    void inherit(Individual &offspring, const Individual &parent)
+    {
+        inherit(fitness, offspring, parent);
+    }
+
+    static FitnessT evaluate(
+        FitnessFunctionT &fitness,
+        Individual &individual,
+        const FitnessT bound)
+    {
+        if constexpr(detail::HasBoundedEvaluation<
+            FitnessFunctionT, Individual>::value)
+            return fitness(individual, bound);
+        else
+            return fitness(individual);
+    }
+
+    /**
+     * \brief Offspring evaluating below the worst individual are the first
+     * to be replaced whatever their exact fitness is. The bound is taken
+     * before the replaced individuals are overwritten.
+     */
+    FitnessT evaluationBound()
+    {
+        if(!bounded_evaluation || worst.empty())
+            return std::numeric_limits<FitnessT>::lowest();
+        return worst.top()->fitness;
+    }
+
+    void newIndividual(
+        Individual &individual,
+        const FitnessT bound = std::numeric_limits<FitnessT>::lowest())
     {
         individual.birthday = year;
-        reevaluateIndividual(individual);
+        individual.fitness = evaluate(fitness, individual, bound);
+        trackIndividual(individual);
+    }
+
+    void clearTracking(const std::size_t size)
+    {
+        best.clear();
+        best.reserve(size);
+        worst.clear();
+        worst.reserve(size);
+        oldest.clear();
+        oldest.reserve(size);
+        if constexpr(detail::HasStatistics<FitnessFunctionT>::value)
+            fitness.statistics() = { };
+        // the population is about to be replaced as a whole
+        if constexpr(detail::HasRankInvalidation<ReplacementStrategyT>::value)
+            replacement.invalidate();
     }
 
     void initializePopulation(const std::size_t size)
     {
         assert(size < std::numeric_limits<std::uint32_t>::max());
         year = 0;
-        best.clear();
-        best.reserve(size);
+        clearTracking(size);
         population.clear();
         population.reserve(size);
         fitness_history.clear();
@@ -132,22 +413,89 @@ struct GeneticOptimizer
             auto &back = population.back();
             back.family = static_cast<std::uint32_t>(i);
             back.index = static_cast<std::uint32_t>(i);
-            newIndividual(back);
+            if(batch_size <= 1)
+                newIndividual(back);
+        }
+        if(batch_size <= 1)
+            return;
+
+        // evaluate the initial population in parallel
+        evaluatePopulation();
+        for(auto &&individual : population)
+        {
+            individual.birthday = year;
+            trackIndividual(individual);
+        }
+    }
+
+    /**
+     * \brief Take over individuals whose genes, birthdays and ancestry were
+     * restored elsewhere, e.g. from a checkpoint. They are evaluated and
+     * tracked again. The year and fitness history are left untouched.
+     */
+    void adoptPopulation(PopulationT individuals)
+    {
+        assert(individuals.size() < std::numeric_limits<std::uint32_t>::max());
+        clearTracking(individuals.size());
+        population = std::move(individuals);
+        for(std::size_t i = 0; i < population.size(); ++i)
+        {
+            auto &individual = population[i];
+            individual.index = static_cast<std::uint32_t>(i);
+            individual.queue_index = best.INVALID_INDEX;
+            individual.worst_queue_index = worst.INVALID_INDEX;
+            individual.age_queue_index = oldest.INVALID_INDEX;
+        }
+        if(batch_size <= 1)
+        {
+            for(auto &&individual : population)
+                individual.fitness = fitness(individual);
+        }
+        else
+        {
+            evaluatePopulation();
         }
+        for(auto &&individual : population)
+            trackIndividual(individual);
+    }
+
+    void evaluatePopulation()
+    {
+        parallelForChunks(population.size(),
+            [this](Worker &w, std::size_t begin, std::size_t end) {
+                for(auto i = begin; i < end; ++i)
+                    population[i].fitness = w.fitness(population[i]);
+            });
     }
 
     void reevaluateIndividual(Individual &individual)
     {
         individual.fitness = fitness(individual);
+        trackIndividual(individual);
+        if constexpr(detail::HasRankInvalidation<ReplacementStrategyT>::value)
+            replacement.invalidate(individual.index);
+    }
 
+    void trackIndividual(Individual &individual)
+    {
         // track best individual (elite)
 
         // first iteration
-        if(individual.queue_index == -1)
+        if(individual.queue_index == best.INVALID_INDEX)
             best.insert(&individual);
         // later iterations
         else
             best.modifyKey(individual.queue_index);
+
+        // track worst and oldest individuals
+        if(individual.worst_queue_index == worst.INVALID_INDEX)
+            worst.insert(&individual);
+        else
+            worst.modifyKey(individual.worst_queue_index);
+        if(individual.age_queue_index == oldest.INVALID_INDEX)
+            oldest.insert(&individual);
+        else
+            oldest.modifyKey(individual.age_queue_index);
     }
 
     bool stopCondition()
@@ -155,15 +503,23 @@ struct GeneticOptimizer
         return stop_condition(*this);
     }
 
-    auto step()
+    void trackFitnessHistory()
     {
-        // track best fitness history
         assert(!best.empty());
         if(last_best_fitness < best.top()->fitness)
         {
             fitness_history.push_back({ best.top()->fitness, year });
             last_best_fitness = best.top()->fitness;
         }
+    }
+
+    auto step()
+    {
+        if(batch_size > 1)
+            return stepBatch();
+
+        // track best fitness history
+        trackFitnessHistory();
 
         // increment time
         ++year;
@@ -172,10 +528,11 @@ struct GeneticOptimizer
         auto [p0, p1] = chooseParents();
         // choose dead individuals and replace them with offspring
         auto [o0, o1] = chooseReplacedIndividuals();
+        const auto bound = evaluationBound();
 
         // copy genes
-        o0.genotype = p0.genotype;
-        o1.genotype = p1.genotype;
+        inherit(o0, p0);
+        inherit(o1, p1);
         // set family
         o0.family = p0.family;
         o0.generation = p0.generation + 1;
@@ -191,8 +548,97 @@ struct GeneticOptimizer
         mutation(o1.genotype, rng);
 
         // evaluate fitness of offspring
-        newIndividual(o0);
-        newIndividual(o1);
+        newIndividual(o0, bound);
+        newIndividual(o1, bound);
+    }
+
+    /**
+     * \brief Produce batch_size pairs of offspring at once. The replaced
+     * individuals are chosen first and never act as parents within the same
+     * batch, so that the offspring can be produced and evaluated in
+     * parallel. Each pair gets its own random engine seeded from rng, which
+     * keeps the results independent of thread scheduling. Elite and fitness
+     * history are updated serially afterwards.
+     */
+    void stepBatch()
+    {
+        // leave at least half of the population to choose parents from
+        const auto pairs = std::max<std::size_t>(
+            std::min(batch_size, population.size() / 4), 1);
+
+        // track best fitness history
+        trackFitnessHistory();
+
+        // choose dead individuals to be replaced by the offspring
+        const auto bound = evaluationBound();
+        replacement(*this, pairs * 2, batch_replaced);
+        batch_replaced_marks.assign(population.size(), 0);
+        for(auto &&i : batch_replaced)
+            batch_replaced_marks[i] = 1;
+
+        // choose parents among the survivors
+        batch_parents.clear();
+        while(batch_parents.size() < pairs * 2)
+        {
+            auto [i0, i1] = parent_selection(*this);
+            for(auto &&i : { i0, i1 })
+            {
+                if(!batch_replaced_marks[i] &&
+                    batch_parents.size() < pairs * 2)
+                    batch_parents.push_back(i);
+            }
+        }
+
+        batch_seeds.resize(pairs);
+        std::generate(batch_seeds.begin(), batch_seeds.end(), std::ref(rng));
+        batch_fitness.resize(pairs * 2);
+
+        parallelForChunks(pairs,
+            [this, bound](Worker &w, std::size_t begin, std::size_t end) {
+                for(auto k = begin; k < end; ++k)
+                {
+                    RngT pair_rng { batch_seeds[k] };
+                    auto &p0 = population[batch_parents[k * 2]];
+                    auto &p1 = population[batch_parents[k * 2 + 1]];
+                    auto &o0 = population[batch_replaced[k * 2]];
+                    auto &o1 = population[batch_replaced[k * 2 + 1]];
+
+                    // copy genes
+                    inherit(w.fitness, o0, p0);
+                    inherit(w.fitness, o1, p1);
+                    // set family
+                    o0.family = p0.family;
+                    o0.generation = p0.generation + 1;
+                    o1.family = p1.family;
+                    o1.generation = p1.generation + 1;
+
+                    std::uniform_real_distribution<> dc(0, crossover_rate);
+                    // crossover
+                    if(dc(pair_rng) < crossover_rate)
+                        w.crossover(o0.genotype, o1.genotype, pair_rng);
+                    // mutation
+                    w.mutation(o0.genotype, pair_rng);
+                    w.mutation(o1.genotype, pair_rng);
+
+                    // evaluate fitness of offspring
+                    batch_fitness[k * 2] = evaluate(w.fitness, o0, bound);
+                    batch_fitness[k * 2 + 1] = evaluate(w.fitness, o1, bound);
+                }
+            });
+
+        // merge the offspring. each pair counts as one year. the keys are
+        // changed one at a time, each repaired before the next.
+        for(std::size_t k = 0; k < pairs; ++k)
+        {
+            ++year;
+            for(auto &&j : { k * 2, k * 2 + 1 })
+            {
+                auto &individual = population[batch_replaced[j]];
+                individual.fitness = batch_fitness[j];
+                individual.birthday = year;
+                trackIndividual(individual);
+            }
+        }
     }
 };
 }
@@ -0,0 +1,273 @@
+﻿#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <type_traits>
+#include <algorithm>
+#include <cassert>
+
+namespace usagi::genetic
+{
+enum class MigrationTopology
+{
+    // island i sends its migrants to island i + 1
+    RING,
+    // every island sends its migrants to all other islands
+    FULLY_CONNECTED,
+};
+
+/**
+ * \brief Single-producer single-consumer ring buffer of genotypes. The
+ * sender never waits: when the receiver hasn't collected earlier migrants
+ * yet, new ones are simply dropped.
+ */
+template <typename Genotype>
+class Mailbox
+{
+    std::vector<Genotype> mSlots;
+    // next slot to be read, only written by the receiver
+    std::atomic<std::size_t> mHead = 0;
+    // next slot to be written, only written by the sender
+    std::atomic<std::size_t> mTail = 0;
+
+public:
+    /**
+     * \brief Not thread-safe. Only call it while no island is running.
+     */
+    void reset(const std::size_t capacity)
+    {
+        mSlots.resize(capacity);
+        mHead = 0;
+        mTail = 0;
+    }
+
+    bool send(const Genotype &genotype)
+    {
+        const auto tail = mTail.load(std::memory_order_relaxed);
+        if(tail - mHead.load(std::memory_order_acquire) >= mSlots.size())
+            return false;
+        // reuses the memory of previous migrants
+        mSlots[tail % mSlots.size()] = genotype;
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * \brief Invoke func(const Genotype &) for each pending migrant.
+     */
+    template <typename Func>
+    void receive(Func &&func)
+    {
+        auto head = mHead.load(std::memory_order_relaxed);
+        const auto tail = mTail.load(std::memory_order_acquire);
+        for(; head != tail; ++head)
+            func(mSlots[head % mSlots.size()]);
+        mHead.store(head, std::memory_order_release);
+    }
+};
+
+/**
+ * \brief Runs several independent GeneticOptimizer instances (islands), each
+ * on its own thread with its own random engine. Every migration_interval
+ * years an island sends copies of its best individuals to its neighbours
+ * and lets the replacement strategy make room for the migrants it received.
+ */
+template <typename Optimizer>
+struct IslandOptimizer
+{
+    using OptimizerT = Optimizer;
+    using GenotypeT = typename Optimizer::GenotypeT;
+
+    std::vector<Optimizer> islands;
+
+    MigrationTopology topology = MigrationTopology::RING;
+    std::uint32_t migration_interval = 500;
+    std::size_t migration_size = 2;
+
+    // mailbox for migrants from island i to island j is at i * n + j
+    std::unique_ptr<Mailbox<GenotypeT>[]> mailboxes;
+
+    /**
+     * \brief Create the islands from a configured optimizer, without
+     * populations. Its population is discarded by each island. The island
+     * engines are seeded from its rng.
+     */
+    void createIslands(
+        const Optimizer &prototype,
+        const std::size_t island_count)
+    {
+        assert(island_count > 0);
+
+        islands.assign(island_count, prototype);
+        auto seeder = prototype.rng;
+        for(auto &&island : islands)
+        {
+            // copies of the prototype engine would produce identical islands
+            island.rng.seed(seeder());
+            island.clearTracking(0);
+            island.population.clear();
+        }
+
+        mailboxes = std::make_unique<Mailbox<GenotypeT>[]>(
+            island_count * island_count);
+        for(std::size_t i = 0; i < island_count * island_count; ++i)
+            mailboxes[i].reset(migration_size * 2);
+    }
+
+    /**
+     * \brief Create the islands and initialize their populations.
+     */
+    void initializeIslands(
+        const Optimizer &prototype,
+        const std::size_t island_count,
+        const std::size_t population_size)
+    {
+        createIslands(prototype, island_count);
+        for(auto &&island : islands)
+            island.initializePopulation(population_size);
+    }
+
+    /**
+     * \brief Whether every island reached its stop condition.
+     */
+    bool stopped()
+    {
+        return std::all_of(islands.begin(), islands.end(),
+            [](Optimizer &o) { return o.stopCondition(); });
+    }
+
+    /**
+     * \brief Evolve all islands in parallel until each of them reaches its
+     * stop condition, or keep_running() returns false.
+     */
+    template <typename KeepRunning>
+    void run(KeepRunning &&keep_running)
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(islands.size());
+        for(std::size_t i = 0; i < islands.size(); ++i)
+        {
+            threads.emplace_back([this, i, &keep_running]() {
+                auto &o = islands[i];
+                auto next_migration = o.year + migration_interval;
+                while(keep_running() && !o.stopCondition())
+                {
+                    o.step();
+                    if(o.year >= next_migration)
+                    {
+                        emigrate(i);
+                        immigrate(i);
+                        next_migration = o.year + migration_interval;
+                    }
+                }
+            });
+        }
+        for(auto &&t : threads)
+            t.join();
+    }
+
+    Optimizer & bestIsland()
+    {
+        assert(!islands.empty());
+        return *std::max_element(islands.begin(), islands.end(),
+            [](Optimizer &a, Optimizer &b) {
+                return a.best.top()->fitness < b.best.top()->fitness;
+            });
+    }
+
+    /**
+     * \brief Sum of the statistics collected by the fitness functions of all
+     * islands. Only available if the fitness function provides statistics().
+     */
+    auto fitnessStatistics() const
+    {
+        std::decay_t<decltype(islands.front().fitness.statistics())> sum { };
+        for(auto &&island : islands)
+            sum += island.fitness.statistics();
+        return sum;
+    }
+
+    /**
+     * \brief Total amount of years simulated by all islands.
+     */
+    std::uint32_t totalYears() const
+    {
+        std::uint32_t years = 0;
+        for(auto &&island : islands)
+            years += island.year;
+        return years;
+    }
+
+private:
+    Mailbox<GenotypeT> & mailbox(const std::size_t from, const std::size_t to)
+    {
+        return mailboxes[from * islands.size() + to];
+    }
+
+    template <typename Func>
+    void forEachNeighbour(const std::size_t island, Func &&func)
+    {
+        const auto n = islands.size();
+        switch(topology)
+        {
+            case MigrationTopology::RING:
+                if(n > 1) func((island + 1) % n);
+                break;
+            case MigrationTopology::FULLY_CONNECTED:
+                for(std::size_t j = 0; j < n; ++j)
+                    if(j != island) func(j);
+                break;
+            default: break;
+        }
+    }
+
+    void emigrate(const std::size_t island)
+    {
+        auto &o = islands[island];
+        const auto count = std::min(migration_size, o.best.size());
+        // pop the elites off the heap and put them back afterwards
+        std::vector<typename Optimizer::IndividualT*> elites;
+        elites.reserve(count);
+        for(std::size_t k = 0; k < count; ++k)
+            elites.push_back(o.best.pop());
+        for(auto &&e : elites)
+        {
+            forEachNeighbour(island, [&](std::size_t to) {
+                mailbox(island, to).send(e->genotype);
+            });
+        }
+        for(auto &&e : elites)
+            o.best.insert(std::move(e));
+    }
+
+    void immigrate(const std::size_t island)
+    {
+        auto &o = islands[island];
+        std::vector<GenotypeT> migrants;
+        for(std::size_t from = 0; from < islands.size(); ++from)
+        {
+            if(from == island) continue;
+            mailbox(from, island).receive([&](const GenotypeT &g) {
+                migrants.push_back(g);
+            });
+        }
+
+        std::size_t k = 0;
+        while(k < migrants.size())
+        {
+            for(auto &&i : o.replacement(o))
+            {
+                if(k == migrants.size()) break;
+                auto &individual = o.population[i];
+                // copy assignment keeps the genes in place, so views into
+                // the genotype held by the individual remain valid.
+                individual.genotype = migrants[k++];
+                o.newIndividual(individual);
+            }
+        }
+    }
+};
+}
@@ -6,6 +6,10 @@
 #include <algorithm>
 #include <atomic>
 #include <execution>
+#include <numeric>
+#include <functional>
+#include <array>
+#include <iterator>
 
 namespace usagi::genetic::replacement
 {
@@ -28,10 +32,14 @@ struct RoundRobinTournamentReplacement
 
     std::vector<Tournament> results;
 
+    /**
+     * \brief Hold the tournament and leave the individuals with the fewest
+     * wins at the front of results.
+     */
     template <typename Optimizer>
-    auto operator()(Optimizer &o)
+    void compete(Optimizer &o, const std::size_t count)
     {
-        assert(o.population.size() >= ReplacementSize);
+        assert(o.population.size() >= count);
         assert(o.population.size() <
             std::numeric_limits<std::uint32_t>::max());
 
@@ -71,9 +79,15 @@ struct RoundRobinTournamentReplacement
         std::shuffle(results.begin(), results.end(), o.rng);
         // find individuals with low wins and let them be replaced
         std::partial_sort(
-            results.begin(), results.begin() + ReplacementSize,
+            results.begin(), results.begin() + count,
             results.end()
         );
+    }
+
+    template <typename Optimizer>
+    auto operator()(Optimizer &o)
+    {
+        compete(o, ReplacementSize);
         std::array<std::size_t, ReplacementSize> replacement;
         for(std::size_t i = 0; i < ReplacementSize; ++i)
         {
@@ -81,30 +95,244 @@ struct RoundRobinTournamentReplacement
         }
         return replacement;
     }
+
+    /**
+     * \brief Choose count distinct individuals to be replaced at once.
+     */
+    template <typename Optimizer>
+    void operator()(
+        Optimizer &o,
+        const std::size_t count,
+        std::vector<std::size_t> &replacement)
+    {
+        compete(o, count);
+        replacement.resize(count);
+        for(std::size_t i = 0; i < count; ++i)
+        {
+            replacement[i] = results[i].index;
+        }
+    }
 };
 
-struct ReplaceOldest
+/**
+ * \brief Same tournament as RoundRobinTournamentReplacement, but the
+ * opponents of each individual are kept across steps along with the wins.
+ * Only the individuals replaced by the previous call and those having them
+ * as opponents are re-ranked, so the cost of a step does not depend on the
+ * population size. The individuals are bucketed by wins, and the ones to be
+ * replaced are drawn randomly from the lowest buckets. All opponents are
+ * redrawn once every refresh_period calls.
+ */
+template <
+    std::size_t TournamentSize = 10,
+    std::size_t ReplacementSize = 2
+>
+struct IncrementalTournamentReplacement
 {
-    template <
-        typename Optimizer,
-        typename Individual = typename Optimizer::IndividualT
-    >
-    auto operator()(Optimizer &o, Individual *other) -> Individual &
+    // # of calls between redrawing the opponents. 0 means population size.
+    std::size_t refresh_period = 0;
+
+    // opponents of individual i are at i * TournamentSize
+    std::vector<std::uint32_t> opponents;
+    // individuals having i as opponent are
+    // challengers[challenger_offsets[i]..challenger_offsets[i + 1]]
+    std::vector<std::uint32_t> challengers;
+    std::vector<std::uint32_t> challenger_offsets;
+    std::vector<std::uint32_t> wins;
+    // individuals grouped by their wins
+    std::vector<std::uint32_t> buckets[TournamentSize + 1];
+    std::vector<std::uint32_t> bucket_positions;
+
+    // replaced by the last call, re-ranked by the next one
+    std::vector<std::size_t> pending;
+    std::size_t calls_since_refresh = 0;
+    std::uint32_t last_year = 0;
+
+    template <typename Optimizer>
+    void rebuild(Optimizer &o)
     {
-        assert(o.population.size() > 1);
-        Individual *oldest = nullptr;
-        // todo priority queue
-        for(auto &&individual : o.population)
+        const auto size = o.population.size();
+        assert(size > 0);
+        assert(size < std::numeric_limits<std::uint32_t>::max());
+
+        std::uniform_int_distribution<std::uint32_t> pos_dist(
+            0, static_cast<std::uint32_t>(size - 1)
+        );
+        opponents.resize(size * TournamentSize);
+        std::generate(opponents.begin(), opponents.end(),
+            std::bind(pos_dist, std::ref(o.rng)));
+
+        // invert the opponent lists
+        challenger_offsets.assign(size + 1, 0);
+        for(auto &&j : opponents)
+            ++challenger_offsets[j + 1];
+        std::partial_sum(challenger_offsets.begin(), challenger_offsets.end(),
+            challenger_offsets.begin());
+        challengers.resize(opponents.size());
+        std::vector<std::uint32_t> fill(
+            challenger_offsets.begin(), challenger_offsets.end() - 1);
+        for(std::size_t i = 0; i < size; ++i)
+        {
+            for(std::size_t k = 0; k < TournamentSize; ++k)
+            {
+                const auto j = opponents[i * TournamentSize + k];
+                challengers[fill[j]++] = static_cast<std::uint32_t>(i);
+            }
+        }
+
+        for(auto &&b : buckets)
+            b.clear();
+        wins.resize(size);
+        bucket_positions.resize(size);
+        for(std::size_t i = 0; i < size; ++i)
+        {
+            wins[i] = compete(o, i);
+            bucket_positions[i] = static_cast<std::uint32_t>(
+                buckets[wins[i]].size());
+            buckets[wins[i]].push_back(static_cast<std::uint32_t>(i));
+        }
+
+        pending.clear();
+        calls_since_refresh = 0;
+    }
+
+    template <typename Optimizer>
+    std::uint32_t compete(Optimizer &o, const std::size_t i) const
+    {
+        std::uint32_t w = 0;
+        for(std::size_t k = 0; k < TournamentSize; ++k)
+        {
+            if(o.population[opponents[i * TournamentSize + k]].fitness <
+                o.population[i].fitness)
+                ++w;
+        }
+        return w;
+    }
+
+    void moveToBucket(const std::size_t i, const std::uint32_t w)
+    {
+        if(wins[i] == w) return;
+        // swap-remove from the old bucket
+        auto &from = buckets[wins[i]];
+        const auto pos = bucket_positions[i];
+        from[pos] = from.back();
+        bucket_positions[from[pos]] = pos;
+        from.pop_back();
+        // append to the new one
+        auto &to = buckets[w];
+        bucket_positions[i] = static_cast<std::uint32_t>(to.size());
+        to.push_back(static_cast<std::uint32_t>(i));
+        wins[i] = w;
+    }
+
+    /**
+     * \brief Re-rank individual i along with its challengers on the next
+     * call, after its fitness changed outside a replacement.
+     */
+    void invalidate(const std::size_t i)
+    {
+        pending.push_back(i);
+    }
+
+    /**
+     * \brief Start over on the next call, e.g. after the population was
+     * replaced as a whole.
+     */
+    void invalidate()
+    {
+        wins.clear();
+    }
+
+    /**
+     * \brief Re-rank the individuals replaced since the last call along with
+     * their challengers, or start over if the population was reinitialized.
+     */
+    template <typename Optimizer>
+    void update(Optimizer &o)
+    {
+        const auto period = refresh_period ? refresh_period
+            : o.population.size();
+        if(wins.size() != o.population.size() || o.year < last_year
+            || ++calls_since_refresh > period)
+        {
+            last_year = o.year;
+            rebuild(o);
+            return;
+        }
+        last_year = o.year;
+        for(auto &&i : pending)
+        {
+            moveToBucket(i, compete(o, i));
+            for(auto c = challenger_offsets[i];
+                c < challenger_offsets[i + 1]; ++c)
+            {
+                moveToBucket(challengers[c], compete(o, challengers[c]));
+            }
+        }
+        pending.clear();
+    }
+
+    /**
+     * \brief Draw count distinct individuals from the lowest buckets. Ties
+     * within a bucket are broken randomly.
+     */
+    template <typename Optimizer, typename Out>
+    void choose(Optimizer &o, const std::size_t count, Out out)
+    {
+        assert(o.population.size() >= count);
+        update(o);
+
+        std::size_t chosen = 0;
+        for(auto &&bucket : buckets)
         {
-            if((oldest == nullptr || individual.birthday < oldest->birthday)
-                && &individual != other)
-                oldest = &individual;
+            // move the chosen ones to the back of the bucket
+            for(std::size_t n = bucket.size(); n > 0 && chosen < count; --n)
+            {
+                std::uniform_int_distribution<std::size_t> dist(0, n - 1);
+                const auto r = dist(o.rng);
+                std::swap(bucket[r], bucket[n - 1]);
+                bucket_positions[bucket[r]] = static_cast<std::uint32_t>(r);
+                bucket_positions[bucket[n - 1]] =
+                    static_cast<std::uint32_t>(n - 1);
+                const auto i = bucket[n - 1];
+                pending.push_back(i);
+                *out++ = i;
+                ++chosen;
+            }
+            if(chosen == count) break;
         }
-        return *oldest;
+    }
+
+    template <typename Optimizer>
+    auto operator()(Optimizer &o)
+    {
+        std::array<std::size_t, ReplacementSize> replacement;
+        choose(o, ReplacementSize, replacement.begin());
+        return replacement;
+    }
+
+    /**
+     * \brief Choose count distinct individuals to be replaced at once.
+     */
+    template <typename Optimizer>
+    void operator()(
+        Optimizer &o,
+        const std::size_t count,
+        std::vector<std::size_t> &replacement)
+    {
+        replacement.resize(count);
+        choose(o, count, replacement.begin());
     }
 };
 
-struct ReplaceWorst
+namespace detail
+{
+/**
+ * \brief Replacement strategies choosing from the top of one of the heaps
+ * maintained by GeneticOptimizer. Heap selects the heap from the optimizer.
+ */
+template <typename Heap>
+struct HeapReplacement
 {
     template <
         typename Optimizer,
@@ -113,15 +341,58 @@ struct ReplaceWorst
     auto operator()(Optimizer &o, Individual *other) -> Individual &
     {
         assert(o.population.size() > 1);
-        Individual *worst = nullptr;
-        // todo priority queue
-        for(auto &&individual : o.population)
-        {
-            if((worst == nullptr || individual.fitness < worst->fitness)
-                && &individual != other)
-                worst = &individual;
-        }
-        return *worst;
+        Individual *candidates[2];
+        Heap()(o).top(2, candidates);
+        return *(candidates[0] != other ? candidates[0] : candidates[1]);
     }
+
+    template <typename Optimizer>
+    auto operator()(Optimizer &o)
+    {
+        std::array<std::size_t, 2> replacement;
+        choose(o, 2, replacement.begin());
+        return replacement;
+    }
+
+    /**
+     * \brief Choose count distinct individuals to be replaced at once.
+     */
+    template <typename Optimizer>
+    void operator()(
+        Optimizer &o,
+        const std::size_t count,
+        std::vector<std::size_t> &replacement)
+    {
+        replacement.resize(count);
+        choose(o, count, replacement.begin());
+    }
+
+private:
+    template <typename Optimizer, typename Out>
+    void choose(Optimizer &o, const std::size_t count, Out out)
+    {
+        assert(o.population.size() >= count);
+        std::vector<typename Optimizer::IndividualT*> candidates;
+        candidates.reserve(count);
+        Heap()(o).top(count, std::back_inserter(candidates));
+        for(auto &&c : candidates)
+            *out++ = c->index;
+    }
+};
+
+struct OldestHeap
+{
+    template <typename Optimizer>
+    auto & operator()(Optimizer &o) const { return o.oldest; }
 };
+
+struct WorstHeap
+{
+    template <typename Optimizer>
+    auto & operator()(Optimizer &o) const { return o.worst; }
+};
+}
+
+using ReplaceOldest = detail::HeapReplacement<detail::OldestHeap>;
+using ReplaceWorst = detail::HeapReplacement<detail::WorstHeap>;
 }
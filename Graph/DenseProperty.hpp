@@ -0,0 +1,35 @@
+﻿#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace usagi
+{
+/**
+ * \brief Vertex property stored in a contiguous array indexed by the
+ * ordinal of the vertex, i.e. its distance from vertex_begin(). Graph
+ * traits use it as property_accessor for properties that every vertex has,
+ * so that algorithms can read and write them without hashing. The storage
+ * is sized by the algorithm before use.
+ */
+template <typename T>
+struct DenseVertexProperty
+{
+    std::vector<T> values;
+
+    void resize(const std::size_t size)
+    {
+        values.resize(size);
+    }
+
+    T & operator[](const std::size_t ordinal)
+    {
+        return values[ordinal];
+    }
+
+    const T & operator[](const std::size_t ordinal) const
+    {
+        return values[ordinal];
+    }
+};
+}
@@ -1,9 +1,17 @@
 ﻿#include "NodeGraph.hpp"
 
 #include <fstream>
+#include <iostream>
+#include <iterator>
+#include <charconv>
+#include <cctype>
+#include <numeric>
+#include <limits>
+#include <cassert>
 
-#include <Usagi/Core/Logging.hpp>
-#include <Usagi/Math/Lerp.hpp>
+#include <GraphLayout/Core/Logging.hpp>
+
+#include "NodeGraphBinary.hpp"
 
 usagi::node_graph::Port::Port(std::string name, Edge edge, float edge_pos)
     : name(std::move(name))
@@ -43,6 +51,19 @@ void usagi::node_graph::NodePrototype::createPorts(
     }
 }
 
+void usagi::node_graph::NodePrototype::updatePortOffsets()
+{
+    const auto offsets = [this](
+        std::vector<Vector2f> &sink,
+        const std::vector<Port> &ports) {
+        sink.resize(ports.size());
+        for(std::size_t i = 0; i < ports.size(); ++i)
+            sink[i] = portPosition(ports[i], Vector2f::Zero());
+    };
+    offsets(out_port_offsets, out_ports);
+    offsets(in_port_offsets, in_ports);
+}
+
 usagi::Vector2f usagi::node_graph::NodePrototype::portPosition(
     const Port &p,
     const Vector2f &position) const
@@ -93,6 +114,46 @@ usagi::node_graph::Link::Link(
 {
 }
 
+usagi::node_graph::NodeGraph::NodeGraph(const NodeGraph &other)
+{
+    *this = other;
+}
+
+usagi::node_graph::NodeGraph & usagi::node_graph::NodeGraph::operator=(
+    const NodeGraph &other)
+{
+    if(this == &other) return *this;
+
+    prototypes = other.prototypes;
+    nodes = other.nodes;
+    links = other.links;
+    size = other.size;
+    out_link_offsets = other.out_link_offsets;
+    out_links = other.out_links;
+    in_link_offsets = other.in_link_offsets;
+    in_links = other.in_links;
+    out_port_base = other.out_port_base;
+    in_port_base = other.in_port_base;
+    out_port_link_offsets = other.out_port_link_offsets;
+    out_port_links = other.out_port_links;
+    in_port_link_offsets = other.in_port_link_offsets;
+    in_port_links = other.in_port_links;
+    link_node0 = other.link_node0;
+    link_node1 = other.link_node1;
+    link_offset0 = other.link_offset0;
+    link_offset1 = other.link_offset1;
+
+    // nodes may also use prototypes owned by someone else, keep those
+    const auto first = other.prototypes.data();
+    const auto last = first + other.prototypes.size();
+    for(auto &&n : nodes)
+    {
+        if(n.prototype >= first && n.prototype < last)
+            n.prototype = prototypes.data() + (n.prototype - first);
+    }
+    return *this;
+}
+
 std::tuple<const usagi::node_graph::Node &, const usagi::node_graph::Port &,
     const usagi::node_graph::Node &, const usagi::node_graph::Port &> usagi::
 node_graph::NodeGraph::mapLink(std::size_t i) const
@@ -108,85 +169,332 @@ node_graph::NodeGraph::mapLink(std::size_t i) const
     );
 }
 
-usagi::node_graph::NodeGraph usagi::node_graph::NodeGraph::readFromFile(
-    const std::filesystem::path &path)
+void usagi::node_graph::NodeGraph::buildAdjacency()
 {
-    std::ifstream in { path };
-    std::string buf;
-    in.exceptions(std::ios::badbit);
-    NodeGraph g;
+    assert(nodes.size() < std::numeric_limits<std::uint32_t>::max());
+    assert(links.size() < std::numeric_limits<std::uint32_t>::max());
+
+    // counting sort of the link indices by key
+    const auto bucket = [this](
+        std::vector<std::uint32_t> &offsets,
+        std::vector<std::uint32_t> &items,
+        const std::size_t key_count,
+        auto &&key) {
+        offsets.assign(key_count + 1, 0);
+        for(std::size_t i = 0; i < links.size(); ++i)
+            ++offsets[key(links[i]) + 1];
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        items.resize(links.size());
+        std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for(std::size_t i = 0; i < links.size(); ++i)
+            items[fill[key(links[i])]++] = static_cast<std::uint32_t>(i);
+    };
 
-    while(in >> buf)
+    bucket(out_link_offsets, out_links, nodes.size(),
+        [](const Link &l) { return l.node0; });
+    bucket(in_link_offsets, in_links, nodes.size(),
+        [](const Link &l) { return l.node1; });
+
+    // first port slot of each node
+    out_port_base.resize(nodes.size() + 1);
+    in_port_base.resize(nodes.size() + 1);
+    out_port_base[0] = in_port_base[0] = 0;
+    for(std::size_t i = 0; i < nodes.size(); ++i)
     {
-        // ignore comment lines
-        if(buf == "#")
-        {
-            std::getline(in, buf);
-        }
-        else if(buf == "canvas")
-        {
-            in >> g.size.x() >> g.size.y();
-            LOG(info, "Canvas Size: {}, {}", g.size.x(), g.size.y());
-        }
-        else if(buf == "proto")
+        out_port_base[i + 1] = out_port_base[i] + static_cast<std::uint32_t>(
+            nodes[i].prototype->out_ports.size());
+        in_port_base[i + 1] = in_port_base[i] + static_cast<std::uint32_t>(
+            nodes[i].prototype->in_ports.size());
+    }
+    bucket(out_port_link_offsets, out_port_links, out_port_base.back(),
+        [this](const Link &l) { return out_port_base[l.node0] + l.port0; });
+    bucket(in_port_link_offsets, in_port_links, in_port_base.back(),
+        [this](const Link &l) { return in_port_base[l.node1] + l.port1; });
+
+    link_node0.resize(links.size());
+    link_node1.resize(links.size());
+    link_offset0.resize(links.size());
+    link_offset1.resize(links.size());
+    for(std::size_t i = 0; i < links.size(); ++i)
+    {
+        auto &l = links[i];
+        link_node0[i] = static_cast<std::uint32_t>(l.node0);
+        link_node1[i] = static_cast<std::uint32_t>(l.node1);
+        link_offset0[i] = nodes[l.node0].prototype->out_port_offsets[l.port0];
+        link_offset1[i] = nodes[l.node1].prototype->in_port_offsets[l.port1];
+    }
+}
+
+namespace
+{
+using namespace usagi;
+using namespace usagi::node_graph;
+
+/**
+ * \brief Tokenizer and parser of the .ng text format working on a buffer
+ * holding the whole file. Numbers are converted with std::from_chars and no
+ * string is allocated except for names.
+ */
+class TextGraphParser
+{
+    std::string_view mText;
+    std::string_view mSource;
+    std::size_t mPos = 0;
+    std::size_t mLine = 1;
+    std::size_t mLineStart = 0;
+    // position of the last token, for error reporting
+    std::size_t mTokenLine = 1;
+    std::size_t mTokenColumn = 1;
+
+    [[noreturn]] void fail(const std::string &what) const
+    {
+        throw GraphParseError(mSource, mTokenLine, mTokenColumn, what);
+    }
+
+    // skip whitespaces and comments. returns false at the end of text.
+    bool skip()
+    {
+        while(mPos < mText.size())
         {
-            std::size_t id;
-            std::string display_name;
-            Vector2f size;
-            std::size_t in_pins, out_pins;
-            in >> id >> std::quoted(display_name)
-                >> size.x() >> size.y()
-                >> in_pins >> out_pins;
-            assert(g.prototypes.size() == id);
-            g.prototypes.emplace_back(
-                display_name, size, in_pins, out_pins);
-            LOG(info, "Node Prototype: #{} ({}) <{}, {}> {}:{}",
-                id, display_name, size.x(), size.y(), in_pins, out_pins
-            );
+            const char c = mText[mPos];
+            if(c == '\n')
+            {
+                ++mLine;
+                mLineStart = ++mPos;
+            }
+            else if(c == ' ' || c == '\t' || c == '\r')
+            {
+                ++mPos;
+            }
+            else if(c == '#')
+            {
+                const auto eol = mText.find('\n', mPos);
+                mPos = eol == std::string_view::npos ? mText.size() : eol;
+            }
+            else
+            {
+                mTokenLine = mLine;
+                mTokenColumn = mPos - mLineStart + 1;
+                return true;
+            }
         }
-        else if(buf == "node")
+        mTokenLine = mLine;
+        mTokenColumn = mPos - mLineStart + 1;
+        return false;
+    }
+
+    std::string_view word()
+    {
+        const auto begin = mPos;
+        while(mPos < mText.size() && !std::isspace(
+            static_cast<unsigned char>(mText[mPos])))
+            ++mPos;
+        return mText.substr(begin, mPos - begin);
+    }
+
+    template <typename T>
+    T number(const char *what)
+    {
+        if(!skip())
+            fail(std::string("expected ") + what + ", got end of file");
+        const auto token = word();
+        T value { };
+        const auto [end, ec] = std::from_chars(
+            token.data(), token.data() + token.size(), value);
+        if(ec != std::errc() || end != token.data() + token.size())
+            fail(std::string("expected ") + what + ", got '"
+                + std::string(token) + "'");
+        return value;
+    }
+
+    // quoted string with \" and \\ escapes, as written by std::quoted
+    std::string quoted(const char *what)
+    {
+        if(!skip() || mText[mPos] != '"')
+            fail(std::string("expected quoted ") + what);
+        std::string value;
+        for(++mPos; mPos < mText.size(); ++mPos)
         {
-            std::size_t id;
-            std::size_t proto;
-            std::string name;
-            in >> id >> proto >> std::quoted(name);
-            assert(g.nodes.size() == id);
-            assert(proto < g.prototypes.size());
-            g.nodes.emplace_back(&g.prototypes[proto], name);
-            LOG(info, "Node: #{}({}) <- {}",
-                id, name, g.prototypes[proto].name
-            );
+            char c = mText[mPos];
+            if(c == '"')
+            {
+                ++mPos;
+                return value;
+            }
+            if(c == '\n')
+                break;
+            if(c == '\\' && mPos + 1 < mText.size())
+                c = mText[++mPos];
+            value.push_back(c);
         }
-        else if(buf == "link")
+        fail(std::string("unterminated ") + what);
+    }
+
+public:
+    TextGraphParser(std::string_view text, std::string_view source)
+        : mText(text)
+        , mSource(source)
+    {
+    }
+
+    NodeGraph parse()
+    {
+        NodeGraph g;
+        // prototypes may be reallocated while parsing, so nodes are linked
+        // to them at the end
+        std::vector<std::size_t> node_prototypes;
+
+        while(skip())
         {
-            std::size_t out_node, out_pin, in_node, in_pin;
-            in >> out_node >> out_pin >> in_node >> in_pin;
-            assert(out_node < g.nodes.size());
-            assert(out_pin < g.nodes[out_node].prototype->out_ports.size());
-            assert(in_node < g.nodes.size());
-            assert(in_pin < g.nodes[in_node].prototype->in_ports.size());
-            g.links.emplace_back(out_node, out_pin, in_node, in_pin);
-            LOG(info, "Link: {}:{}->{}:{}",
-                out_node, out_pin, in_node, in_pin
-            );
+            const auto keyword = word();
+            if(keyword == "canvas")
+            {
+                g.size.x() = number<float>("canvas width");
+                g.size.y() = number<float>("canvas height");
+            }
+            else if(keyword == "proto")
+            {
+                const auto id = number<std::size_t>("prototype id");
+                if(id != g.prototypes.size())
+                    fail(fmt::format("expected prototype id {}, got {}",
+                        g.prototypes.size(), id));
+                auto name = quoted("prototype name");
+                Vector2f size;
+                size.x() = number<float>("prototype width");
+                size.y() = number<float>("prototype height");
+                const auto in_pins = number<std::size_t>("input pin count");
+                const auto out_pins = number<std::size_t>("output pin count");
+                g.prototypes.emplace_back(
+                    std::move(name), size, in_pins, out_pins);
+            }
+            else if(keyword == "node")
+            {
+                const auto id = number<std::size_t>("node id");
+                if(id != g.nodes.size())
+                    fail(fmt::format("expected node id {}, got {}",
+                        g.nodes.size(), id));
+                const auto proto = number<std::size_t>("prototype id");
+                if(proto >= g.prototypes.size())
+                    fail(fmt::format("undefined prototype {}", proto));
+                g.nodes.emplace_back(nullptr, quoted("node name"));
+                node_prototypes.push_back(proto);
+            }
+            else if(keyword == "link")
+            {
+                std::size_t ends[4];
+                const char *names[4] = {
+                    "output node", "output pin", "input node", "input pin"
+                };
+                for(std::size_t i = 0; i < 4; ++i)
+                    ends[i] = number<std::size_t>(names[i]);
+                for(std::size_t i = 0; i < 4; i += 2)
+                {
+                    if(ends[i] >= g.nodes.size())
+                        fail(fmt::format("undefined {} {}",
+                            names[i], ends[i]));
+                    auto &proto = g.prototypes[node_prototypes[ends[i]]];
+                    const auto pins = i == 0
+                        ? proto.out_ports.size()
+                        : proto.in_ports.size();
+                    if(ends[i + 1] >= pins)
+                        fail(fmt::format("{} {} out of range, node {} has {}",
+                            names[i + 1], ends[i + 1], ends[i], pins));
+                }
+                g.links.emplace_back(ends[0], ends[1], ends[2], ends[3]);
+            }
+            else
+            {
+                fail("unknown keyword '" + std::string(keyword) + "'");
+            }
         }
-        else
+
+        for(std::size_t i = 0; i < g.nodes.size(); ++i)
+            g.nodes[i].prototype = &g.prototypes[node_prototypes[i]];
+        g.buildAdjacency();
+
+        LOG(info, "Loaded {}: canvas {}x{}, {} prototypes, {} nodes, {} links",
+            mSource, g.size.x(), g.size.y(),
+            g.prototypes.size(), g.nodes.size(), g.links.size());
+
+        return g;
+    }
+};
+}
+
+usagi::node_graph::GraphParseError::GraphParseError(
+    std::string_view source,
+    const std::size_t line,
+    const std::size_t column,
+    const std::string &what)
+    : std::runtime_error(fmt::format("{}:{}:{}: {}", source, line, column, what))
+    , line(line)
+    , column(column)
+{
+}
+
+usagi::node_graph::NodeGraph usagi::node_graph::NodeGraph::readFromFile(
+    const std::filesystem::path &path)
+{
+    if(path == "-")
+        return readFromStream(std::cin, "<stdin>");
+    if(path.extension() == ".ngb")
+        return binary::MappedNodeGraph(path).toNodeGraph();
+
+    std::ifstream in { path, std::ios::binary };
+    if(!in)
+        throw std::runtime_error("Failed to open " + path.u8string());
+    return readFromStream(in, path.u8string());
+}
+
+usagi::node_graph::NodeGraph usagi::node_graph::NodeGraph::readFromStream(
+    std::istream &in,
+    std::string_view source)
+{
+    std::string text;
+    in.exceptions(std::ios::badbit);
+    // read the whole stream at once
+    if(in.seekg(0, std::ios::end))
+    {
+        const auto size = in.tellg();
+        if(size > 0)
         {
-            assert(false);
+            text.resize(static_cast<std::size_t>(size));
+            in.seekg(0, std::ios::beg);
+            in.read(text.data(), size);
+            text.resize(static_cast<std::size_t>(in.gcount()));
         }
     }
+    else
+    {
+        // not seekable, e.g. a pipe
+        in.clear();
+        text.assign(std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>());
+    }
+    return readFromMemory(text, source);
+}
 
-    return g;
+usagi::node_graph::NodeGraph usagi::node_graph::NodeGraph::readFromMemory(
+    std::string_view text,
+    std::string_view source)
+{
+    return TextGraphParser(text, source).parse();
 }
 
-std::tuple<usagi::Vector2f, usagi::Vector2f> usagi::node_graph::NodeGraphInstance::
-mapLinkEndPoints(std::size_t i) const
+void usagi::node_graph::NodeGraphInstance::mapAllLinkEndPoints(
+    Vector2f *p0,
+    Vector2f *p1) const
 {
-    auto [n0, p0, n1, p1] = base_graph->mapLink(i);
-    auto &l = base_graph->link(i);
-    auto pos0 = n0.prototype->portPosition(p0, node_positions[l.node0]);
-    auto pos1 = n1.prototype->portPosition(p1, node_positions[l.node1]);
-    return { pos0, pos1 };
+    const auto link_count = base_graph->links.size();
+    const auto *node0 = base_graph->link_node0.data();
+    const auto *node1 = base_graph->link_node1.data();
+    const auto *offset0 = base_graph->link_offset0.data();
+    const auto *offset1 = base_graph->link_offset1.data();
+    for(std::size_t i = 0; i < link_count; ++i)
+    {
+        p0[i] = node_positions[node0[i]] + offset0[i];
+        p1[i] = node_positions[node1[i]] + offset1[i];
+    }
 }
 
 usagi::AlignedBox2f usagi::node_graph::NodeGraphInstance::mapNodeRegion(
@@ -1,9 +1,12 @@
 ﻿#pragma once
 
 #include <vector>
+#include <cstdint>
+#include <string_view>
+#include <istream>
+#include <stdexcept>
 
-#include <Usagi/Math/Matrix.hpp>
-#include <Usagi/Math/Bound.hpp>
+#include <GraphLayout/Core/Math.hpp>
 #include <filesystem>
 
 namespace usagi::node_graph
@@ -32,6 +35,8 @@ struct NodePrototype
     std::string name;
     Vector2f size;
     std::vector<Port> out_ports, in_ports;
+    // port positions relative to the node position, see updatePortOffsets()
+    std::vector<Vector2f> out_port_offsets, in_port_offsets;
 
     NodePrototype(std::string name, Vector2f size);
     NodePrototype(
@@ -48,13 +53,21 @@ struct NodePrototype
     void createOutPorts(std::size_t amount)
     {
         createPorts(out_ports, amount, Port::Edge::EAST);
+        updatePortOffsets();
     }
 
     void createInPorts(std::size_t amount)
     {
         createPorts(in_ports, amount, Port::Edge::WEST);
+        updatePortOffsets();
     }
 
+    /**
+     * \brief Recompute the port offsets. Must be called after the ports or
+     * the size are changed.
+     */
+    void updatePortOffsets();
+
     Vector2f portPosition(const Port &p, const Vector2f &position) const;
 
     const Port & outPort(std::size_t i) const
@@ -91,6 +104,40 @@ struct Link
         std::size_t port1);
 };
 
+struct GraphParseError : std::runtime_error
+{
+    std::size_t line;
+    std::size_t column;
+
+    GraphParseError(
+        std::string_view source,
+        std::size_t line,
+        std::size_t column,
+        const std::string &what);
+};
+
+/**
+ * \brief A range of link indices in one of the adjacency lists of NodeGraph.
+ */
+struct LinkRange
+{
+    const std::uint32_t *first = nullptr;
+    const std::uint32_t *last = nullptr;
+
+    const std::uint32_t * begin() const { return first; }
+    const std::uint32_t * end() const { return last; }
+    std::size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+
+    static LinkRange of(
+        const std::vector<std::uint32_t> &offsets,
+        const std::vector<std::uint32_t> &items,
+        const std::size_t i)
+    {
+        return { items.data() + offsets[i], items.data() + offsets[i + 1] };
+    }
+};
+
 struct NodeGraph
 {
     std::vector<NodePrototype> prototypes;
@@ -98,6 +145,31 @@ struct NodeGraph
     std::vector<Link> links;
     Vector2f size { 1000, 1000 };
 
+    // adjacency in compressed sparse row form, built by buildAdjacency().
+    // links leaving node i are
+    // out_links[out_link_offsets[i]] ~ out_links[out_link_offsets[i + 1] - 1]
+    // and likewise for the others. port lists are indexed by the first port
+    // slot of each node plus the port index.
+    std::vector<std::uint32_t> out_link_offsets, out_links;
+    std::vector<std::uint32_t> in_link_offsets, in_links;
+    std::vector<std::uint32_t> out_port_base, in_port_base;
+    std::vector<std::uint32_t> out_port_link_offsets, out_port_links;
+    std::vector<std::uint32_t> in_port_link_offsets, in_port_links;
+    // endpoint nodes of each link and the offsets of their ports, for
+    // passes over all links
+    std::vector<std::uint32_t> link_node0, link_node1;
+    std::vector<Vector2f> link_offset0, link_offset1;
+
+    NodeGraph() = default;
+    /**
+     * \brief Copies point the nodes to their own prototypes instead of the
+     * prototypes of the source graph.
+     */
+    NodeGraph(const NodeGraph &other);
+    NodeGraph(NodeGraph &&other) = default;
+    NodeGraph & operator=(const NodeGraph &other);
+    NodeGraph & operator=(NodeGraph &&other) = default;
+
     const Node & node(std::size_t i) const
     {
         return nodes[i];
@@ -111,7 +183,47 @@ struct NodeGraph
     std::tuple<const Node&, const Port&, const Node&, const Port&>
     mapLink(std::size_t i) const;
 
+    /**
+     * \brief Rebuild the adjacency lists and the link endpoint arrays. Must
+     * be called after nodes or links are changed.
+     */
+    void buildAdjacency();
+
+    LinkRange outLinks(std::size_t node) const
+    {
+        return LinkRange::of(out_link_offsets, out_links, node);
+    }
+
+    LinkRange inLinks(std::size_t node) const
+    {
+        return LinkRange::of(in_link_offsets, in_links, node);
+    }
+
+    LinkRange outPortLinks(std::size_t node, std::size_t port) const
+    {
+        return LinkRange::of(out_port_link_offsets, out_port_links,
+            out_port_base[node] + port);
+    }
+
+    LinkRange inPortLinks(std::size_t node, std::size_t port) const
+    {
+        return LinkRange::of(in_port_link_offsets, in_port_links,
+            in_port_base[node] + port);
+    }
+
+    /**
+     * \brief Read a .ng text file, or a .ngb binary file by mapping it.
+     * A .ngb file skips parsing, but its records are still copied into the
+     * returned graph. Path "-" reads the text format from stdin. Throws GraphParseError if
+     * the text is malformed.
+     */
     static NodeGraph readFromFile(const std::filesystem::path &path);
+    static NodeGraph readFromStream(
+        std::istream &in,
+        std::string_view source = "<stream>");
+    static NodeGraph readFromMemory(
+        std::string_view text,
+        std::string_view source = "<memory>");
 };
 
 struct NodeGraphInstance
@@ -119,7 +231,20 @@ struct NodeGraphInstance
     const NodeGraph *base_graph = nullptr;
     Vector2f *node_positions = nullptr;
 
-    std::tuple<Vector2f, Vector2f> mapLinkEndPoints(std::size_t i) const;
+    std::tuple<Vector2f, Vector2f> mapLinkEndPoints(std::size_t i) const
+    {
+        return {
+            node_positions[base_graph->link_node0[i]]
+                + base_graph->link_offset0[i],
+            node_positions[base_graph->link_node1[i]]
+                + base_graph->link_offset1[i]
+        };
+    }
+
+    /**
+     * \brief Compute the end points of all links at once.
+     */
+    void mapAllLinkEndPoints(Vector2f *p0, Vector2f *p1) const;
 
     Vector2f mapNodePosition(std::size_t node_index) const
     {
@@ -0,0 +1,335 @@
+﻿#include "NodeGraphBinary.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <vector>
+#include <functional>
+
+#include <GraphLayout/Core/Logging.hpp>
+
+#ifdef _WIN32
+#    define WIN32_LEAN_AND_MEAN
+#    include <Windows.h>
+#    undef min
+#    undef max
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace
+{
+constexpr std::size_t align4(const std::size_t size)
+{
+    return (size + 3) & ~std::size_t(3);
+}
+}
+
+usagi::node_graph::binary::MappedNodeGraph::MappedNodeGraph(
+    const std::filesystem::path &path)
+{
+#ifdef _WIN32
+    const auto file = CreateFileW(path.c_str(), GENERIC_READ,
+        FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Failed to open " + path.u8string());
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        throw std::runtime_error("Empty graph file " + path.u8string());
+    }
+    mSize = static_cast<std::size_t>(size.QuadPart);
+    mMapping = CreateFileMappingW(
+        file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    // the mapping keeps the file open
+    CloseHandle(file);
+    if(!mMapping)
+        throw std::runtime_error("Failed to map " + path.u8string());
+    mData = static_cast<const std::byte*>(
+        MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    if(!mData)
+    {
+        CloseHandle(mMapping);
+        throw std::runtime_error("Failed to map " + path.u8string());
+    }
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("Failed to open " + path.u8string());
+    struct stat st { };
+    if(fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        throw std::runtime_error("Empty graph file " + path.u8string());
+    }
+    mSize = static_cast<std::size_t>(st.st_size);
+    void *data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file open
+    close(fd);
+    if(data == MAP_FAILED)
+        throw std::runtime_error("Failed to map " + path.u8string());
+    mData = static_cast<const std::byte*>(data);
+#endif
+
+    try
+    {
+        validate();
+    }
+    catch(...)
+    {
+        unmap();
+        throw;
+    }
+}
+
+usagi::node_graph::binary::MappedNodeGraph::~MappedNodeGraph()
+{
+    unmap();
+}
+
+void usagi::node_graph::binary::MappedNodeGraph::unmap()
+{
+    if(!mData) return;
+#ifdef _WIN32
+    UnmapViewOfFile(mData);
+    CloseHandle(mMapping);
+#else
+    munmap(const_cast<std::byte*>(mData), mSize);
+#endif
+    mData = nullptr;
+    mMapping = nullptr;
+}
+
+void usagi::node_graph::binary::MappedNodeGraph::validate()
+{
+    const auto fail = [](const char *what) {
+        throw std::runtime_error(
+            std::string("Malformed binary node graph: ") + what);
+    };
+
+    if(mSize < sizeof(FileHeader))
+        fail("truncated header");
+    auto &h = *reinterpret_cast<const FileHeader*>(mData);
+    if(std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0)
+        fail("bad magic");
+    if(h.version != VERSION)
+        fail("unsupported version");
+    if(h.byte_order != BYTE_ORDER_MARK)
+        fail("written on a machine of another byte order");
+
+    // compute the section offsets in 64-bit to avoid overflows
+    std::uint64_t offset = sizeof(FileHeader);
+    const auto section = [&](std::uint64_t count, std::uint64_t size) {
+        const auto begin = offset;
+        offset += count * size;
+        return begin;
+    };
+    const auto strings = section(1, align4(h.string_table_size));
+    const auto prototypes = section(h.prototype_count, sizeof(PrototypeRecord));
+    const auto ports = section(h.port_count, sizeof(PortRecord));
+    const auto nodes = section(h.node_count, sizeof(NodeRecord));
+    const auto links = section(h.link_count, sizeof(LinkRecord));
+    if(offset > mSize)
+        fail("truncated records");
+
+    mHeader = &h;
+    mStrings = reinterpret_cast<const char*>(mData + strings);
+    mPrototypes = reinterpret_cast<const PrototypeRecord*>(
+        mData + prototypes);
+    mPorts = reinterpret_cast<const PortRecord*>(mData + ports);
+    mNodes = reinterpret_cast<const NodeRecord*>(mData + nodes);
+    mLinks = reinterpret_cast<const LinkRecord*>(mData + links);
+
+    const auto check_string = [&](const StringRef &s) {
+        if(std::uint64_t(s.offset) + s.length > h.string_table_size)
+            fail("string out of range");
+    };
+    for(std::uint32_t i = 0; i < h.prototype_count; ++i)
+    {
+        auto &p = mPrototypes[i];
+        check_string(p.name);
+        if(std::uint64_t(p.first_port) + p.in_count + p.out_count
+            > h.port_count)
+            fail("prototype ports out of range");
+    }
+    for(std::uint32_t i = 0; i < h.port_count; ++i)
+    {
+        check_string(mPorts[i].name);
+        if(mPorts[i].edge > static_cast<std::uint32_t>(Port::Edge::EAST))
+            fail("invalid port edge");
+    }
+    for(std::uint32_t i = 0; i < h.node_count; ++i)
+    {
+        check_string(mNodes[i].name);
+        if(mNodes[i].prototype >= h.prototype_count)
+            fail("node prototype out of range");
+    }
+    for(std::uint32_t i = 0; i < h.link_count; ++i)
+    {
+        auto &l = mLinks[i];
+        if(l.node0 >= h.node_count || l.node1 >= h.node_count)
+            fail("link node out of range");
+        if(l.port0 >= mPrototypes[mNodes[l.node0].prototype].out_count ||
+            l.port1 >= mPrototypes[mNodes[l.node1].prototype].in_count)
+            fail("link port out of range");
+    }
+}
+
+usagi::node_graph::NodeGraph
+    usagi::node_graph::binary::MappedNodeGraph::toNodeGraph() const
+{
+    auto &h = header();
+    NodeGraph g;
+    g.size = { h.canvas_width, h.canvas_height };
+
+    const auto to_port = [&](const PortRecord &r) {
+        return Port {
+            std::string(string(r.name)),
+            static_cast<Port::Edge>(r.edge),
+            r.edge_pos
+        };
+    };
+    g.prototypes.reserve(h.prototype_count);
+    for(std::uint32_t i = 0; i < h.prototype_count; ++i)
+    {
+        auto &r = mPrototypes[i];
+        auto &p = g.prototypes.emplace_back(
+            std::string(string(r.name)), Vector2f { r.width, r.height });
+        p.in_ports.reserve(r.in_count);
+        p.out_ports.reserve(r.out_count);
+        for(std::uint32_t j = 0; j < r.in_count; ++j)
+            p.in_ports.push_back(to_port(mPorts[r.first_port + j]));
+        for(std::uint32_t j = 0; j < r.out_count; ++j)
+            p.out_ports.push_back(
+                to_port(mPorts[r.first_port + r.in_count + j]));
+        p.updatePortOffsets();
+    }
+
+    g.nodes.reserve(h.node_count);
+    for(std::uint32_t i = 0; i < h.node_count; ++i)
+    {
+        g.nodes.emplace_back(&g.prototypes[mNodes[i].prototype],
+            std::string(string(mNodes[i].name)));
+    }
+
+    g.links.reserve(h.link_count);
+    for(std::uint32_t i = 0; i < h.link_count; ++i)
+    {
+        auto &l = mLinks[i];
+        g.links.emplace_back(l.node0, l.port0, l.node1, l.port1);
+    }
+    g.buildAdjacency();
+
+    return g;
+}
+
+void usagi::node_graph::binary::writeNodeGraph(
+    const NodeGraph &graph,
+    const std::filesystem::path &path)
+{
+    std::string strings;
+    const auto add_string = [&](const std::string &s) {
+        const StringRef ref {
+            static_cast<std::uint32_t>(strings.size()),
+            static_cast<std::uint32_t>(s.size())
+        };
+        strings += s;
+        return ref;
+    };
+
+    std::vector<PrototypeRecord> prototypes;
+    std::vector<PortRecord> ports;
+    std::vector<NodeRecord> nodes;
+    std::vector<LinkRecord> links;
+
+    const auto add_port = [&](const Port &p) {
+        ports.push_back({
+            add_string(p.name),
+            static_cast<std::uint32_t>(p.edge),
+            p.edge_pos
+        });
+    };
+    prototypes.reserve(graph.prototypes.size());
+    for(auto &&p : graph.prototypes)
+    {
+        prototypes.push_back({
+            add_string(p.name),
+            p.size.x(), p.size.y(),
+            static_cast<std::uint32_t>(ports.size()),
+            static_cast<std::uint32_t>(p.in_ports.size()),
+            static_cast<std::uint32_t>(p.out_ports.size())
+        });
+        for(auto &&port : p.in_ports) add_port(port);
+        for(auto &&port : p.out_ports) add_port(port);
+    }
+    nodes.reserve(graph.nodes.size());
+    const auto first = graph.prototypes.data();
+    const auto last = first + graph.prototypes.size();
+    for(auto &&n : graph.nodes)
+    {
+        // nodes may point at prototypes owned by another graph, which have
+        // no index here. std::less orders unrelated pointers too.
+        if(std::less<>()(n.prototype, first) ||
+            !std::less<>()(n.prototype, last))
+        {
+            throw std::runtime_error(
+                "Node " + n.name + " uses a prototype of another graph");
+        }
+        nodes.push_back({
+            static_cast<std::uint32_t>(n.prototype - first),
+            add_string(n.name)
+        });
+    }
+    links.reserve(graph.links.size());
+    for(auto &&l : graph.links)
+    {
+        links.push_back({
+            static_cast<std::uint32_t>(l.node0),
+            static_cast<std::uint32_t>(l.port0),
+            static_cast<std::uint32_t>(l.node1),
+            static_cast<std::uint32_t>(l.port1)
+        });
+    }
+
+    FileHeader header { };
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.canvas_width = graph.size.x();
+    header.canvas_height = graph.size.y();
+    header.string_table_size = static_cast<std::uint32_t>(strings.size());
+    header.prototype_count = static_cast<std::uint32_t>(prototypes.size());
+    header.port_count = static_cast<std::uint32_t>(ports.size());
+    header.node_count = static_cast<std::uint32_t>(nodes.size());
+    header.link_count = static_cast<std::uint32_t>(links.size());
+    strings.resize(align4(strings.size()), '\0');
+
+    std::ofstream out { path, std::ios::binary };
+    out.exceptions(std::ios::badbit | std::ios::failbit);
+    const auto write = [&](const void *data, std::size_t size) {
+        out.write(static_cast<const char*>(data),
+            static_cast<std::streamsize>(size));
+    };
+    write(&header, sizeof(header));
+    write(strings.data(), strings.size());
+    write(prototypes.data(), prototypes.size() * sizeof(PrototypeRecord));
+    write(ports.data(), ports.size() * sizeof(PortRecord));
+    write(nodes.data(), nodes.size() * sizeof(NodeRecord));
+    write(links.data(), links.size() * sizeof(LinkRecord));
+}
+
+void usagi::node_graph::binary::convertToBinary(
+    const std::filesystem::path &text_path,
+    const std::filesystem::path &binary_path)
+{
+    const auto graph = NodeGraph::readFromFile(text_path);
+    writeNodeGraph(graph, binary_path);
+    LOG(info, "Converted {} to {}: {} prototypes, {} nodes, {} links",
+        text_path, binary_path,
+        graph.prototypes.size(), graph.nodes.size(), graph.links.size());
+}
@@ -0,0 +1,162 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <filesystem>
+#include <type_traits>
+
+#include "NodeGraph.hpp"
+
+/**
+ * Binary node graph format (.ngb). All fields are 32-bit words in the byte
+ * order of the machine that wrote the file, so that the file can be mapped
+ * into memory and its arrays accessed in place. The header records that
+ * byte order, and files from machines of the other one are rejected. The
+ * layout is:
+ *
+ *     FileHeader
+ *     char            strings[header.string_table_size]  (padded to 4 bytes)
+ *     PrototypeRecord prototypes[header.prototype_count]
+ *     PortRecord      ports[header.port_count]
+ *     NodeRecord      nodes[header.node_count]
+ *     LinkRecord      links[header.link_count]
+ *
+ * Strings are referenced by byte offset and length into the string table
+ * and are not null-terminated.
+ */
+namespace usagi::node_graph::binary
+{
+constexpr char MAGIC[4] = { 'N', 'G', 'B', '1' };
+constexpr std::uint32_t VERSION = 2;
+// reads as another value on machines of the other byte order
+constexpr std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct StringRef
+{
+    std::uint32_t offset = 0;
+    std::uint32_t length = 0;
+};
+
+struct FileHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    float canvas_width;
+    float canvas_height;
+    std::uint32_t string_table_size;
+    std::uint32_t prototype_count;
+    std::uint32_t port_count;
+    std::uint32_t node_count;
+    std::uint32_t link_count;
+};
+
+struct PrototypeRecord
+{
+    StringRef name;
+    float width;
+    float height;
+    // ports of the prototype are ports[first_port..first_port + in_count)
+    // followed by out_count output ports.
+    std::uint32_t first_port;
+    std::uint32_t in_count;
+    std::uint32_t out_count;
+};
+
+struct PortRecord
+{
+    StringRef name;
+    std::uint32_t edge;
+    float edge_pos;
+};
+
+struct NodeRecord
+{
+    std::uint32_t prototype;
+    StringRef name;
+};
+
+struct LinkRecord
+{
+    std::uint32_t node0;
+    std::uint32_t port0;
+    std::uint32_t node1;
+    std::uint32_t port1;
+};
+
+static_assert(std::is_trivially_copyable_v<FileHeader>);
+static_assert(sizeof(FileHeader) == 40);
+static_assert(sizeof(PrototypeRecord) == 28);
+static_assert(sizeof(PortRecord) == 16);
+static_assert(sizeof(NodeRecord) == 12);
+static_assert(sizeof(LinkRecord) == 16);
+
+/**
+ * \brief Read-only view of a .ngb file mapped into memory. The records are
+ * accessed in place, nothing is copied or allocated per element. The file is
+ * validated when opened, so that indices and string references in the
+ * records can be used without further checks. Throws std::runtime_error if
+ * the file cannot be mapped or is malformed.
+ */
+class MappedNodeGraph
+{
+    const std::byte *mData = nullptr;
+    std::size_t mSize = 0;
+    // platform handle of the mapping
+    void *mMapping = nullptr;
+
+    const FileHeader *mHeader = nullptr;
+    const char *mStrings = nullptr;
+    const PrototypeRecord *mPrototypes = nullptr;
+    const PortRecord *mPorts = nullptr;
+    const NodeRecord *mNodes = nullptr;
+    const LinkRecord *mLinks = nullptr;
+
+    void validate();
+    void unmap();
+
+public:
+    explicit MappedNodeGraph(const std::filesystem::path &path);
+    ~MappedNodeGraph();
+
+    MappedNodeGraph(const MappedNodeGraph &other) = delete;
+    MappedNodeGraph & operator=(const MappedNodeGraph &other) = delete;
+
+    const FileHeader & header() const { return *mHeader; }
+
+    std::string_view string(const StringRef &ref) const
+    {
+        return { mStrings + ref.offset, ref.length };
+    }
+
+    const PrototypeRecord & prototype(std::size_t i) const
+    {
+        return mPrototypes[i];
+    }
+
+    const PortRecord & port(std::size_t i) const { return mPorts[i]; }
+    const NodeRecord & node(std::size_t i) const { return mNodes[i]; }
+    const LinkRecord & link(std::size_t i) const { return mLinks[i]; }
+
+    /**
+     * \brief Build a NodeGraph usable by the optimizer. Each array of the
+     * graph is allocated once, but NodeGraph owns its names, so every name
+     * longer than the small string buffer is still allocated and copied.
+     */
+    NodeGraph toNodeGraph() const;
+};
+
+/**
+ * \brief Write graph in the binary format. Throws std::runtime_error if a
+ * node uses a prototype not stored in graph.prototypes.
+ */
+void writeNodeGraph(const NodeGraph &graph, const std::filesystem::path &path);
+
+/**
+ * \brief Convert a .ng text file to the binary format.
+ */
+void convertToBinary(
+    const std::filesystem::path &text_path,
+    const std::filesystem::path &binary_path);
+}
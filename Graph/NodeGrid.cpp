@@ -0,0 +1,80 @@
+﻿#include "NodeGrid.hpp"
+
+#include <cmath>
+
+void usagi::node_graph::NodeGrid::rebuild(const NodeGraphInstance &graph)
+{
+    const auto node_count = graph.base_graph->nodes.size();
+
+    mCellNodes.clear();
+    if(node_count == 0)
+        return;
+
+    // find the extent of all nodes and the largest node size
+    mBounds = AlignedBox2f();
+    Vector2f max_size = Vector2f::Zero();
+    for(std::size_t i = 0; i < node_count; ++i)
+    {
+        const auto r = graph.mapNodeRegion(i);
+        mBounds.extend(r);
+        max_size = max_size.cwiseMax(r.sizes());
+    }
+
+    const Vector2f extent = mBounds.sizes();
+    mCellSize = std::max({
+        // each node covers at most 2x2 cells
+        max_size.x(), max_size.y(),
+        // roughly one node per cell
+        std::sqrt(extent.x() * extent.y() / node_count),
+        // keep the grid from degenerating into a long strip
+        std::max(extent.x(), extent.y()) / node_count,
+        1.f
+    });
+    mColumns = static_cast<std::size_t>(extent.x() / mCellSize) + 1;
+    mRows = static_cast<std::size_t>(extent.y() / mCellSize) + 1;
+
+    // counting sort nodes into cells
+    const auto cell_count = mColumns * mRows;
+    mCellStart.assign(cell_count + 1, 0);
+    const auto for_each_cell = [&](std::size_t node, auto &&func) {
+        const auto r = graph.mapNodeRegion(node);
+        const auto c0 = column(r.min().x()), c1 = column(r.max().x());
+        const auto r0 = row(r.min().y()), r1 = row(r.max().y());
+        for(auto y = r0; y <= r1; ++y)
+            for(auto x = c0; x <= c1; ++x)
+                func(y * mColumns + x);
+    };
+    for(std::size_t i = 0; i < node_count; ++i)
+    {
+        for_each_cell(i, [&](std::size_t cell) {
+            ++mCellStart[cell + 1];
+        });
+    }
+    for(std::size_t i = 0; i < cell_count; ++i)
+        mCellStart[i + 1] += mCellStart[i];
+    mCellNodes.resize(mCellStart.back());
+    // use the starts as insertion cursors, then shift them back
+    for(std::size_t i = 0; i < node_count; ++i)
+    {
+        for_each_cell(i, [&](std::size_t cell) {
+            mCellNodes[mCellStart[cell]++] = static_cast<std::uint32_t>(i);
+        });
+    }
+    std::copy_backward(
+        mCellStart.begin(), mCellStart.end() - 1, mCellStart.end());
+    mCellStart.front() = 0;
+
+    mVisited.assign(node_count, 0);
+    mQueryStamp = 0;
+}
+
+std::uint32_t usagi::node_graph::NodeGrid::nextQueryStamp()
+{
+    // reset the marks when the stamp wraps around
+    if(++mQueryStamp == 0)
+    {
+        std::fill(mVisited.begin(), mVisited.end(), 0);
+        mQueryStamp = 1;
+    }
+    return mQueryStamp;
+}
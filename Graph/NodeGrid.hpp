@@ -0,0 +1,93 @@
+﻿#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include <GraphLayout/Core/Math.hpp>
+
+#include "NodeGraph.hpp"
+
+namespace usagi::node_graph
+{
+/**
+ * \brief Uniform grid over the node rectangles of a NodeGraphInstance.
+ * Each node is registered in every cell covered by its region, so that
+ * region queries only visit nodes in the neighbourhood instead of the whole
+ * graph. The grid is meant to be rebuilt whenever node positions change,
+ * i.e. once per fitness evaluation.
+ */
+class NodeGrid
+{
+    AlignedBox2f mBounds;
+    float mCellSize = 1;
+    std::size_t mColumns = 0;
+    std::size_t mRows = 0;
+
+    // compressed cell lists: nodes in cell i are
+    // mCellNodes[mCellStart[i]] ~ mCellNodes[mCellStart[i + 1] - 1]
+    std::vector<std::uint32_t> mCellStart;
+    std::vector<std::uint32_t> mCellNodes;
+
+    // avoid visiting nodes spanning multiple cells more than once
+    std::vector<std::uint32_t> mVisited;
+    std::uint32_t mQueryStamp = 0;
+
+    std::size_t column(float x) const
+    {
+        const auto c = (x - mBounds.min().x()) / mCellSize;
+        return static_cast<std::size_t>(
+            std::clamp(c, 0.f, static_cast<float>(mColumns - 1)));
+    }
+
+    std::size_t row(float y) const
+    {
+        const auto r = (y - mBounds.min().y()) / mCellSize;
+        return static_cast<std::size_t>(
+            std::clamp(r, 0.f, static_cast<float>(mRows - 1)));
+    }
+
+    std::uint32_t nextQueryStamp();
+
+public:
+    /**
+     * \brief Rebuild the cell lists from the current node positions.
+     * The cell size is chosen so that the largest node covers at most 2x2
+     * cells and the amount of cells stays linear in the amount of nodes.
+     */
+    void rebuild(const NodeGraphInstance &graph);
+
+    /**
+     * \brief Invoke visitor(node_index) once for each node whose cells overlap
+     * with the given region. Callers still have to perform the exact test
+     * since the cells are conservative.
+     */
+    template <typename Visitor>
+    void query(const AlignedBox2f &region, Visitor &&visitor)
+    {
+        if(mCellNodes.empty() || region.isEmpty())
+            return;
+
+        const auto stamp = nextQueryStamp();
+        const auto c0 = column(region.min().x());
+        const auto c1 = column(region.max().x());
+        const auto r0 = row(region.min().y());
+        const auto r1 = row(region.max().y());
+        for(auto r = r0; r <= r1; ++r)
+        {
+            for(auto c = c0; c <= c1; ++c)
+            {
+                const auto cell = r * mColumns + c;
+                for(auto i = mCellStart[cell]; i < mCellStart[cell + 1]; ++i)
+                {
+                    const auto node = mCellNodes[i];
+                    if(mVisited[node] == stamp)
+                        continue;
+                    mVisited[node] = stamp;
+                    visitor(static_cast<std::size_t>(node));
+                }
+            }
+        }
+    }
+};
+}
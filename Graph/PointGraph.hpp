@@ -0,0 +1,141 @@
+﻿#pragma once
+
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+#include "DenseProperty.hpp"
+
+namespace usagi
+{
+template <typename Vector>
+struct EigenVectorTraits
+{
+    void set_zeros(Vector &v) const
+    {
+        v.setZero();
+    }
+
+    Vector normalized(const Vector &v) const
+    {
+        return v.normalized();
+    }
+
+    float length(const Vector &v) const
+    {
+        return v.norm();
+    }
+};
+
+/**
+ * \brief Flat point graph for the force-directed layouts. Vertices are
+ * ordinals into the position array and edges are stored once as pairs of
+ * ordinals. Vertex properties live in separate arrays of the same order
+ * (DenseVertexProperty), so the layout loops run on contiguous memory.
+ */
+template <
+    typename Vector,
+    typename VectorTraits = EigenVectorTraits<Vector>
+>
+struct PointGraph
+{
+    using EdgeT = std::pair<std::uint32_t, std::uint32_t>;
+
+    std::vector<Vector> positions;
+    std::vector<EdgeT> edges;
+
+    std::uint32_t addVertex(const Vector &position)
+    {
+        positions.push_back(position);
+        return static_cast<std::uint32_t>(positions.size() - 1);
+    }
+
+    /**
+     * \brief Linear in the number of edges.
+     */
+    bool hasEdge(const std::uint32_t a, const std::uint32_t b) const
+    {
+        const EdgeT e { std::min(a, b), std::max(a, b) };
+        return std::find(edges.begin(), edges.end(), e) != edges.end();
+    }
+
+    /**
+     * \brief Edges must not repeat, the layouts would apply their forces
+     * twice. Callers deduplicate, the check only runs in debug builds.
+     */
+    void addEdge(const std::uint32_t a, const std::uint32_t b)
+    {
+        assert(a != b);
+        assert(a < positions.size() && b < positions.size());
+        assert(!hasEdge(a, b));
+        edges.emplace_back(std::min(a, b), std::max(a, b));
+    }
+
+    void clear()
+    {
+        positions.clear();
+        edges.clear();
+    }
+
+    struct Traits
+    {
+        using vector_t = Vector;
+        using vector_traits_t = VectorTraits;
+        using vertex_iterator_t = Vector *;
+        using edge_iterator_t = typename std::vector<EdgeT>::iterator;
+
+        template <typename Tag>
+        using property_accessor = DenseVertexProperty<Vector>;
+
+        vertex_iterator_t vertex_begin(PointGraph *g) const
+        {
+            return g->positions.data();
+        }
+
+        vertex_iterator_t vertex_end(PointGraph *g) const
+        {
+            return g->positions.data() + g->positions.size();
+        }
+
+        Vector & position(vertex_iterator_t i) const
+        {
+            return *i;
+        }
+
+        edge_iterator_t edge_begin(PointGraph *g) const
+        {
+            return g->edges.begin();
+        }
+
+        edge_iterator_t edge_end(PointGraph *g) const
+        {
+            return g->edges.end();
+        }
+
+        std::pair<vertex_iterator_t, vertex_iterator_t> edge_vertices(
+            PointGraph *g,
+            edge_iterator_t e) const
+        {
+            return { vertex_begin(g) + e->first, vertex_begin(g) + e->second };
+        }
+
+        /**
+         * \brief Linear in the number of edges. Layouts enumerate the edges
+         * instead.
+         */
+        bool is_adjacent(
+            PointGraph *g,
+            vertex_iterator_t a,
+            vertex_iterator_t b) const
+        {
+            return g->hasEdge(
+                static_cast<std::uint32_t>(a - vertex_begin(g)),
+                static_cast<std::uint32_t>(b - vertex_begin(g)));
+        }
+    };
+
+    using traits_t = Traits;
+};
+}
@@ -0,0 +1,183 @@
+﻿#include "SegmentIntersection.hpp"
+
+#if defined(USAGI_NO_SIMD)
+    // scalar fallback only
+#elif defined(__AVX2__)
+#    include <immintrin.h>
+#    define SEGMENT_BATCH_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define SEGMENT_BATCH_SSE
+#endif
+
+// The lanes follow the scalar formula operation by operation, including the
+// two divisions, so that the results are identical to the per-pair test.
+// This only holds without floating point contraction, which would fuse the
+// scalar code into FMAs differently from the lanes, so the build disables it
+// for this file.
+// https://stackoverflow.com/questions/563198/how-do-you-detect-where-two-line-segments-intersect
+
+std::uint32_t usagi::node_graph::intersectSegmentBatch(
+    const Vector2f &p0,
+    const Vector2f &p1,
+    const SegmentBatch &batch,
+    const Vector2f &ignore0,
+    const Vector2f &ignore1)
+{
+    const float s1x = p1.x() - p0.x();
+    const float s1y = p1.y() - p0.y();
+    std::uint32_t mask = 0;
+
+#if defined(SEGMENT_BATCH_AVX)
+    constexpr std::size_t WIDTH = 8;
+    const __m256 sign = _mm256_set1_ps(-0.f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.f);
+    const __m256 v_s1x = _mm256_set1_ps(s1x);
+    const __m256 v_s1y = _mm256_set1_ps(s1y);
+    const __m256 v_neg_s1y = _mm256_set1_ps(-s1y);
+    const __m256 v_p0x = _mm256_set1_ps(p0.x());
+    const __m256 v_p0y = _mm256_set1_ps(p0.y());
+    const __m256 v_i0x = _mm256_set1_ps(ignore0.x());
+    const __m256 v_i0y = _mm256_set1_ps(ignore0.y());
+    const __m256 v_i1x = _mm256_set1_ps(ignore1.x());
+    const __m256 v_i1y = _mm256_set1_ps(ignore1.y());
+    for(std::size_t k = 0; k < batch.size; k += WIDTH)
+    {
+        const __m256 x0 = _mm256_load_ps(batch.x0 + k);
+        const __m256 y0 = _mm256_load_ps(batch.y0 + k);
+        const __m256 s2x = _mm256_sub_ps(_mm256_load_ps(batch.x1 + k), x0);
+        const __m256 s2y = _mm256_sub_ps(_mm256_load_ps(batch.y1 + k), y0);
+        const __m256 dx = _mm256_sub_ps(v_p0x, x0);
+        const __m256 dy = _mm256_sub_ps(v_p0y, y0);
+        const __m256 denom = _mm256_add_ps(
+            _mm256_mul_ps(_mm256_xor_ps(s2x, sign), v_s1y),
+            _mm256_mul_ps(v_s1x, s2y));
+        const __m256 s = _mm256_div_ps(_mm256_add_ps(
+            _mm256_mul_ps(v_neg_s1y, dx),
+            _mm256_mul_ps(v_s1x, dy)), denom);
+        const __m256 t = _mm256_div_ps(_mm256_sub_ps(
+            _mm256_mul_ps(s2x, dy),
+            _mm256_mul_ps(s2y, dx)), denom);
+        const __m256 hit = _mm256_and_ps(
+            _mm256_and_ps(
+                _mm256_cmp_ps(s, zero, _CMP_GE_OQ),
+                _mm256_cmp_ps(s, one, _CMP_LE_OQ)),
+            _mm256_and_ps(
+                _mm256_cmp_ps(t, zero, _CMP_GE_OQ),
+                _mm256_cmp_ps(t, one, _CMP_LE_OQ)));
+        const __m256 hx = _mm256_add_ps(v_p0x, _mm256_mul_ps(t, v_s1x));
+        const __m256 hy = _mm256_add_ps(v_p0y, _mm256_mul_ps(t, v_s1y));
+        const __m256 ignored = _mm256_or_ps(
+            _mm256_and_ps(
+                _mm256_cmp_ps(hx, v_i0x, _CMP_EQ_OQ),
+                _mm256_cmp_ps(hy, v_i0y, _CMP_EQ_OQ)),
+            _mm256_and_ps(
+                _mm256_cmp_ps(hx, v_i1x, _CMP_EQ_OQ),
+                _mm256_cmp_ps(hy, v_i1y, _CMP_EQ_OQ)));
+        mask |= static_cast<std::uint32_t>(
+            _mm256_movemask_ps(_mm256_andnot_ps(ignored, hit))) << k;
+    }
+#elif defined(SEGMENT_BATCH_SSE)
+    constexpr std::size_t WIDTH = 4;
+    const __m128 sign = _mm_set1_ps(-0.f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 v_s1x = _mm_set1_ps(s1x);
+    const __m128 v_s1y = _mm_set1_ps(s1y);
+    const __m128 v_neg_s1y = _mm_set1_ps(-s1y);
+    const __m128 v_p0x = _mm_set1_ps(p0.x());
+    const __m128 v_p0y = _mm_set1_ps(p0.y());
+    const __m128 v_i0x = _mm_set1_ps(ignore0.x());
+    const __m128 v_i0y = _mm_set1_ps(ignore0.y());
+    const __m128 v_i1x = _mm_set1_ps(ignore1.x());
+    const __m128 v_i1y = _mm_set1_ps(ignore1.y());
+    for(std::size_t k = 0; k < batch.size; k += WIDTH)
+    {
+        const __m128 x0 = _mm_load_ps(batch.x0 + k);
+        const __m128 y0 = _mm_load_ps(batch.y0 + k);
+        const __m128 s2x = _mm_sub_ps(_mm_load_ps(batch.x1 + k), x0);
+        const __m128 s2y = _mm_sub_ps(_mm_load_ps(batch.y1 + k), y0);
+        const __m128 dx = _mm_sub_ps(v_p0x, x0);
+        const __m128 dy = _mm_sub_ps(v_p0y, y0);
+        const __m128 denom = _mm_add_ps(
+            _mm_mul_ps(_mm_xor_ps(s2x, sign), v_s1y),
+            _mm_mul_ps(v_s1x, s2y));
+        const __m128 s = _mm_div_ps(_mm_add_ps(
+            _mm_mul_ps(v_neg_s1y, dx),
+            _mm_mul_ps(v_s1x, dy)), denom);
+        const __m128 t = _mm_div_ps(_mm_sub_ps(
+            _mm_mul_ps(s2x, dy),
+            _mm_mul_ps(s2y, dx)), denom);
+        const __m128 hit = _mm_and_ps(
+            _mm_and_ps(_mm_cmpge_ps(s, zero), _mm_cmple_ps(s, one)),
+            _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmple_ps(t, one)));
+        const __m128 hx = _mm_add_ps(v_p0x, _mm_mul_ps(t, v_s1x));
+        const __m128 hy = _mm_add_ps(v_p0y, _mm_mul_ps(t, v_s1y));
+        const __m128 ignored = _mm_or_ps(
+            _mm_and_ps(_mm_cmpeq_ps(hx, v_i0x), _mm_cmpeq_ps(hy, v_i0y)),
+            _mm_and_ps(_mm_cmpeq_ps(hx, v_i1x), _mm_cmpeq_ps(hy, v_i1y)));
+        mask |= static_cast<std::uint32_t>(
+            _mm_movemask_ps(_mm_andnot_ps(ignored, hit))) << k;
+    }
+#else
+    for(std::size_t k = 0; k < batch.size; ++k)
+    {
+        const float s2x = batch.x1[k] - batch.x0[k];
+        const float s2y = batch.y1[k] - batch.y0[k];
+        const float dx = p0.x() - batch.x0[k];
+        const float dy = p0.y() - batch.y0[k];
+        const float denom = -s2x * s1y + s1x * s2y;
+        const float s = (-s1y * dx + s1x * dy) / denom;
+        const float t = (s2x * dy - s2y * dx) / denom;
+        if(!(s >= 0 && s <= 1 && t >= 0 && t <= 1))
+            continue;
+        const float hx = p0.x() + t * s1x;
+        const float hy = p0.y() + t * s1y;
+        if(hx == ignore0.x() && hy == ignore0.y()) continue;
+        if(hx == ignore1.x() && hy == ignore1.y()) continue;
+        mask |= 1u << k;
+    }
+#endif
+
+    // padding lanes are degenerate and never hit, but be safe
+    return mask & ((1u << batch.size) - 1);
+}
+
+usagi::Vector2f usagi::node_graph::segmentBatchCrossing(
+    const Vector2f &p0,
+    const Vector2f &p1,
+    const SegmentBatch &batch,
+    const std::size_t k)
+{
+    const float s1x = p1.x() - p0.x();
+    const float s1y = p1.y() - p0.y();
+    const float s2x = batch.x1[k] - batch.x0[k];
+    const float s2y = batch.y1[k] - batch.y0[k];
+    const float dx = p0.x() - batch.x0[k];
+    const float dy = p0.y() - batch.y0[k];
+    const float denom = -s2x * s1y + s1x * s2y;
+    const float t = (s2x * dy - s2y * dx) / denom;
+    return { p0.x() + t * s1x, p0.y() + t * s1y };
+}
+
+std::size_t usagi::node_graph::intersectSegmentBatches(
+    const SegmentBatch &a,
+    const SegmentBatch &b,
+    const Vector2f &ignore0,
+    const Vector2f &ignore1,
+    std::uint32_t *hit_masks)
+{
+    std::size_t hits = 0;
+    for(std::size_t i = 0; i < a.size; ++i)
+    {
+        const auto mask = intersectSegmentBatch(
+            { a.x0[i], a.y0[i] }, { a.x1[i], a.y1[i] },
+            b, ignore0, ignore1);
+        hits += countHits(mask);
+        if(hit_masks)
+            hit_masks[i] = mask;
+    }
+    return hits;
+}
@@ -0,0 +1,100 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+
+#include <GraphLayout/Core/Math.hpp>
+
+namespace usagi::node_graph
+{
+/**
+ * \brief A structure-of-arrays batch of line segments, e.g. the segments of a
+ * bezier curve or the edges of a node box. Unused lanes are zero-length
+ * segments, which never intersect anything.
+ */
+struct SegmentBatch
+{
+    static constexpr std::size_t CAPACITY = 8;
+
+    alignas(32) float x0[CAPACITY] { };
+    alignas(32) float y0[CAPACITY] { };
+    alignas(32) float x1[CAPACITY] { };
+    alignas(32) float y1[CAPACITY] { };
+    std::size_t size = 0;
+
+    void push(const Vector2f &p0, const Vector2f &p1)
+    {
+        assert(size < CAPACITY);
+        x0[size] = p0.x();
+        y0[size] = p0.y();
+        x1[size] = p1.x();
+        y1[size] = p1.y();
+        ++size;
+    }
+
+    /**
+     * \brief Fill the batch with the segments of a polyline.
+     */
+    template <typename Points>
+    void assignPolyline(const Points &points)
+    {
+        clear();
+        for(std::size_t i = 0; i + 1 < points.size(); ++i)
+            push(points[i], points[i + 1]);
+    }
+
+    void clear()
+    {
+        for(std::size_t i = 0; i < size; ++i)
+            x0[i] = y0[i] = x1[i] = y1[i] = 0;
+        size = 0;
+    }
+};
+
+/**
+ * \brief Test segment p0-p1 against every segment in the batch. Produces the
+ * same results as testing each pair separately: intersections located
+ * exactly at ignore0 or ignore1 are not counted.
+ * Uses AVX2 or SSE when available and falls back to scalar code otherwise.
+ * \return Bit i is set if the segment intersects segment i of the batch.
+ */
+std::uint32_t intersectSegmentBatch(
+    const Vector2f &p0,
+    const Vector2f &p1,
+    const SegmentBatch &batch,
+    const Vector2f &ignore0,
+    const Vector2f &ignore1);
+
+/**
+ * \brief The point where segment p0-p1 crosses segment k of the batch,
+ * computed from the same values as the lanes of intersectSegmentBatch(), so
+ * that it is exact for every hit reported there.
+ */
+Vector2f segmentBatchCrossing(
+    const Vector2f &p0,
+    const Vector2f &p1,
+    const SegmentBatch &batch,
+    std::size_t k);
+
+/**
+ * \brief Test every segment of batch a against every segment of batch b.
+ * \param hit_masks If not null, receives one mask per segment of a, in the
+ * format returned by intersectSegmentBatch().
+ * \return The amount of intersecting segment pairs.
+ */
+std::size_t intersectSegmentBatches(
+    const SegmentBatch &a,
+    const SegmentBatch &b,
+    const Vector2f &ignore0,
+    const Vector2f &ignore1,
+    std::uint32_t *hit_masks = nullptr);
+
+inline std::size_t countHits(std::uint32_t mask)
+{
+    std::size_t count = 0;
+    for(; mask; mask &= mask - 1)
+        ++count;
+    return count;
+}
+}
@@ -0,0 +1,882 @@
+﻿#include "PortGraphFitness.hpp"
+
+#include <array>
+#include <numeric>
+#include <chrono>
+
+#if GRAPHLAYOUT_FITNESS_PROFILE
+#   define FITNESS_PROFILE_COUNT(counter, n) (profile.counter += (n))
+#   define FITNESS_PROFILE_TIME(term) const TermTimer term_timer { \
+        profile.nanoseconds[FitnessProfile::term] }
+#else
+#   define FITNESS_PROFILE_COUNT(counter, n) ((void)0)
+#   define FITNESS_PROFILE_TIME(term) ((void)0)
+#endif
+
+namespace
+{
+using namespace usagi;
+
+/**
+ * \brief Adds the time elapsed during its lifetime to sink.
+ */
+class TermTimer
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::uint64_t &mSink;
+    const Clock::time_point mBegin = Clock::now();
+
+public:
+    explicit TermTimer(std::uint64_t &sink) : mSink(sink)
+    {
+    }
+
+    ~TermTimer()
+    {
+        mSink += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock::now() - mBegin).count();
+    }
+};
+
+// segment pairs tested by one curve-curve and one curve-node test
+constexpr std::size_t CURVE_CURVE_SEGMENT_TESTS =
+    PortGraphIndividual::BEZIER_SEGMENT_COUNT *
+    PortGraphIndividual::BEZIER_SEGMENT_COUNT;
+constexpr std::size_t CURVE_NODE_SEGMENT_TESTS =
+    PortGraphIndividual::BEZIER_SEGMENT_COUNT * 4;
+
+// from imgui
+template <std::size_t I>
+void PathBezierCurveTo(
+    std::array<Vector2f, I> &points,
+    const Vector2f &p1,
+    const Vector2f &p2,
+    const Vector2f &p3,
+    const Vector2f &p4)
+{
+    points[0] = p1;
+    float t_step = 1.0f / (float)(I - 1);
+    for(std::size_t i_step = 1; i_step <= I - 1; i_step++)
+    {
+        float t = t_step * static_cast<float>(i_step);
+        float u = 1.0f - t;
+        float w1 = u * u*u;
+        float w2 = 3 * u*u*t;
+        float w3 = 3 * u*t*t;
+        float w4 = t * t*t;
+        points[i_step] = Vector2f(
+            w1*p1.x() + w2 * p2.x() + w3 * p3.x() + w4 * p4.x(),
+            w1*p1.y() + w2 * p2.y() + w3 * p3.y() + w4 * p4.y()
+        );
+    }
+}
+
+// the control factors tried by the routing heuristic
+constexpr std::array<float, 4> BEZIER_CONTROL_FACTORS = {
+    0.8f, 0.6f, 0.4f, 0.2f
+};
+constexpr float BEZIER_MAX_CONTROL_FACTOR = 0.8f;
+
+using ControlFactors = std::pair<float, float>;
+constexpr std::size_t ROUTING_CANDIDATE_COUNT =
+    BEZIER_CONTROL_FACTORS.size() * BEZIER_CONTROL_FACTORS.size();
+
+/**
+ * \brief All combinations of control factors in the order tried by the
+ * routing heuristic: symmetric curves first.
+ */
+const std::array<ControlFactors, ROUTING_CANDIDATE_COUNT> &
+    getRoutingCandidates()
+{
+    static const auto candidates = [] {
+        std::array<ControlFactors, ROUTING_CANDIDATE_COUNT> c;
+        std::size_t k = 0;
+        for(auto &&a : BEZIER_CONTROL_FACTORS)
+            for(auto &&b : BEZIER_CONTROL_FACTORS)
+                c[k++] = { a, b };
+        std::stable_sort(c.begin(), c.end(), [](auto &x, auto &y) {
+            return std::abs(x.first - x.second)
+                < std::abs(y.first - y.second);
+        });
+        return c;
+    }();
+    return candidates;
+}
+
+/**
+ * \brief The region covering all curves the routing heuristic may choose
+ * for a link, i.e. the bounding box of the control points using the largest
+ * control factor. Slightly enlarged to cover rounding errors of the sampled
+ * curve points.
+ */
+AlignedBox2f getRoutingRegion(const Vector2f &p0, const Vector2f &p1)
+{
+    const auto [a, b, c, d] = getBezierControlPoints(
+        p0, p1, Vector2f::Zero(),
+        BEZIER_MAX_CONTROL_FACTOR, BEZIER_MAX_CONTROL_FACTOR);
+    AlignedBox2f region { a };
+    region.extend(b);
+    region.extend(c);
+    region.extend(d);
+    const Vector2f tolerance = Vector2f::Constant(1e-3f * (1.f + std::max(
+        region.min().cwiseAbs().maxCoeff(),
+        region.max().cwiseAbs().maxCoeff())));
+    region.min() -= tolerance;
+    region.max() += tolerance;
+    return region;
+}
+
+// build bezier curves and bounding box
+void buildBezierCurve(
+    PortGraphIndividual::BezierInfo &curve,
+    const Vector2f &p0,
+    const Vector2f &p1,
+    const float control_factor_a,
+    const float control_factor_b)
+{
+    curve.factor_a = control_factor_a;
+    curve.factor_b = control_factor_b;
+    auto [a, b, c, d] = getBezierControlPoints(p0, p1, Vector2f::Zero(), curve.factor_a, curve.factor_b);
+    // PathBezierToCasteljau(bezier_points[i], a, b, c, d);
+    PathBezierCurveTo(curve.points, a, b, c, d);
+    curve.bbox = AlignedBox2f();
+    for(auto &&p : curve.points)
+    {
+        curve.bbox.extend(p);
+    }
+}
+
+void assignBoxEdges(node_graph::SegmentBatch &edges, const AlignedBox2f &r)
+{
+    edges.clear();
+    edges.push(
+        r.corner(AlignedBox2f::TopLeft),
+        r.corner(AlignedBox2f::TopRight));
+    edges.push(
+        r.corner(AlignedBox2f::BottomLeft),
+        r.corner(AlignedBox2f::BottomRight));
+    edges.push(
+        r.corner(AlignedBox2f::TopLeft),
+        r.corner(AlignedBox2f::BottomLeft));
+    edges.push(
+        r.corner(AlignedBox2f::TopRight),
+        r.corner(AlignedBox2f::BottomRight));
+}
+
+bool nodesOverlap(const AlignedBox2f &r0, const AlignedBox2f &r1)
+{
+    return !r0.intersection(r1).isEmpty();
+}
+
+// record the crossing points found by the batch test
+void insertCrossings(
+    const node_graph::SegmentBatch &a,
+    const node_graph::SegmentBatch &b,
+    const std::uint32_t *hit_masks,
+    std::vector<Vector2f> &crosses)
+{
+    for(std::size_t i = 0; i < a.size; ++i)
+    {
+        for(std::size_t j = 0; j < b.size; ++j)
+        {
+            if(!(hit_masks[i] & (1u << j))) continue;
+            crosses.push_back(node_graph::segmentBatchCrossing(
+                { a.x0[i], a.y0[i] }, { a.x1[i], a.y1[i] }, b, j));
+        }
+    }
+}
+
+std::size_t countCurveCrossings(
+    const PortGraphIndividual::BezierInfo &curve,
+    const PortGraphIndividual::BezierInfo &other,
+    std::vector<Vector2f> *crosses)
+{
+    using namespace node_graph;
+
+    // estimate bezier intersections: test each of our line segments
+    // against all of their line segments at once
+    SegmentBatch segments, other_segments;
+    segments.assignPolyline(curve.points);
+    other_segments.assignPolyline(other.points);
+    std::uint32_t hit_masks[SegmentBatch::CAPACITY];
+    const auto cross = intersectSegmentBatches(
+        segments, other_segments,
+        // don't count lines starting from the same port
+        curve.points.front(),
+        // don't count lines ending at the same port
+        curve.points.back(),
+        hit_masks
+    );
+    if(crosses && cross)
+    {
+        insertCrossings(segments, other_segments, hit_masks, *crosses);
+    }
+    return cross;
+}
+}
+
+std::tuple<usagi::Vector2f, usagi::Vector2f, usagi::Vector2f, usagi::Vector2f>
+    usagi::getBezierControlPoints(
+    const Vector2f &p0,
+    const Vector2f &p1,
+    const Vector2f &offset,
+    const float control_factor_a,
+    const float control_factor_b)
+{
+    const Vector2f size = (p1 - p0).cwiseAbs();
+    // const auto control_x = std::min(size.x(), 250.f);
+    const auto control_x = size.x();
+
+    return std::make_tuple(
+        Vector2f(p0.x() + offset.x(), p0.y() + offset.y()),
+        Vector2f(
+            p0.x() + offset.x() + control_x * control_factor_a,
+            p0.y() + offset.y()
+        ),
+        Vector2f(
+            p1.x() + offset.x() - control_x * control_factor_b,
+            p1.y() + offset.y()),
+        Vector2f(p1.x() + offset.x(), p1.y() + offset.y())
+    );
+}
+
+void PortGraphFitness::findOverlappingCurves()
+{
+    const auto link_count = curves.size();
+    curve_pairs.clear();
+    if(link_count < 2) return;
+
+    // sweep along the axis on which the boxes are least crowded
+    AlignedBox2f span;
+    Vector2f extent_sum = Vector2f::Zero();
+    for(auto &&c : curves)
+    {
+        span.extend(c.bbox);
+        extent_sum += c.bbox.sizes();
+    }
+    const Vector2f crowd = extent_sum.cwiseQuotient(
+        span.sizes().cwiseMax(Vector2f::Constant(1)));
+    const int axis = crowd.x() <= crowd.y() ? 0 : 1;
+
+    curve_order.resize(link_count);
+    std::iota(curve_order.begin(), curve_order.end(), 0);
+    std::sort(curve_order.begin(), curve_order.end(),
+        [&](const std::uint32_t a, const std::uint32_t b) {
+            return curves[a].bbox.min()[axis]
+                < curves[b].bbox.min()[axis];
+        });
+
+    active_curves.clear();
+    for(auto &&i : curve_order)
+    {
+        auto &box = curves[i].bbox;
+        // prune the boxes which ended before this one starts
+        active_curves.erase(std::remove_if(
+            active_curves.begin(), active_curves.end(),
+            [&](const std::uint32_t j) {
+                return curves[j].bbox.max()[axis] < box.min()[axis];
+            }), active_curves.end());
+        // the remaining ones overlap on the sweep axis, check the other one
+        for(auto &&j : active_curves)
+        {
+            if(box.intersects(curves[j].bbox))
+                curve_pairs.emplace_back(std::min(i, j), std::max(i, j));
+            else
+                FITNESS_PROFILE_COUNT(bbox_rejects, 1);
+        }
+        active_curves.push_back(i);
+    }
+}
+
+std::size_t PortGraphFitness::countNodeEdgeCrossings(
+    const PortGraphIndividual &g,
+    const PortGraphIndividual::BezierInfo &curve,
+    std::vector<Vector2f> *crosses)
+{
+    std::size_t cross = 0;
+
+    // estimate bezier and node intersections
+
+    node_graph::SegmentBatch segments, box_edges;
+    segments.assignPolyline(curve.points);
+    std::uint32_t hit_masks[node_graph::SegmentBatch::CAPACITY];
+
+    // for each node box near the curve
+    node_grid.query(curve.bbox, [&](const std::size_t j) {
+        auto r = g.graph.mapNodeRegion(j);
+        // the curve cannot intersect with this node
+        if(!curve.bbox.intersects(r))
+        {
+            FITNESS_PROFILE_COUNT(bbox_rejects, 1);
+            return;
+        }
+        // test our line segments with each of the node box edges
+        FITNESS_PROFILE_COUNT(segment_tests, CURVE_NODE_SEGMENT_TESTS);
+        assignBoxEdges(box_edges, r);
+        const auto x = intersectSegmentBatches(
+            segments, box_edges,
+            // don't count line beginning and ending as crossings
+            curve.points.front(),
+            curve.points.back(),
+            hit_masks
+        );
+        if(crosses && x)
+        {
+            insertCrossings(segments, box_edges, hit_masks, *crosses);
+        }
+        cross += x;
+    });
+    return cross;
+}
+
+void PortGraphFitness::buildCurves(
+    const node_graph::NodeGraphInstance &layout,
+    const PortGraphIndividual::EvaluationCache &cache)
+{
+    curves.resize(cache.links.size());
+    for(std::size_t m = 0; m < curves.size(); ++m)
+    {
+        auto [p0, p1] = layout.mapLinkEndPoints(m);
+        buildBezierCurve(curves[m], p0, p1,
+            cache.links[m].factor_a, cache.links[m].factor_b);
+    }
+}
+
+void PortGraphFitness::mapLinkEndPoints(const PortGraphIndividual &g)
+{
+    const auto link_count = g.graph.base_graph->links.size();
+    link_ends0.resize(link_count);
+    link_ends1.resize(link_count);
+    g.graph.mapAllLinkEndPoints(link_ends0.data(), link_ends1.data());
+}
+
+void PortGraphFitness::measureLink(
+    PortGraphIndividual &g,
+    const std::size_t i)
+{
+    auto &terms = g.cache.links[i];
+    Vector2f edge_diff = link_ends1[i] - link_ends0[i];
+    Vector2f normalized_edge = edge_diff.normalized();
+    // normalized edge direction using dot product. prefer edge towards
+    // right.
+    const auto angle = std::acos(normalized_edge.dot(Vector2f::UnitX()));
+    terms.dx = edge_diff.x();
+    terms.angle = radiansToDegrees(angle);
+}
+
+void PortGraphFitness::routeLink(
+    PortGraphIndividual &g,
+    const std::size_t m)
+{
+    using namespace node_graph;
+
+    auto &terms = g.cache.links[m];
+    auto &p0 = link_ends0[m];
+    auto &p1 = link_ends1[m];
+
+    if(!heuristic)
+    {
+        terms.factor_a = terms.factor_b = BEZIER_MAX_CONTROL_FACTOR;
+        buildBezierCurve(curves[m], p0, p1, terms.factor_a, terms.factor_b);
+        terms.node_crossings = static_cast<std::uint32_t>(
+            countNodeEdgeCrossings(g, curves[m], nullptr));
+        return;
+    }
+
+    // sample all candidate curves at once
+    auto &candidates = getRoutingCandidates();
+    std::array<PortGraphIndividual::BezierInfo, ROUTING_CANDIDATE_COUNT>
+        candidate_curves;
+    AlignedBox2f region;
+    for(std::size_t k = 0; k < candidate_curves.size(); ++k)
+    {
+        buildBezierCurve(candidate_curves[k], p0, p1,
+            candidates[k].first, candidates[k].second);
+        region.extend(candidate_curves[k].bbox);
+    }
+
+    // cull the nodes only once against the union of all candidates
+    routing_nodes.clear();
+    routing_node_edges.clear();
+    node_grid.query(region, [&](const std::size_t j) {
+        const auto r = g.graph.mapNodeRegion(j);
+        if(!region.intersects(r))
+        {
+            FITNESS_PROFILE_COUNT(bbox_rejects, 1);
+            return;
+        }
+        routing_nodes.push_back(r);
+        assignBoxEdges(routing_node_edges.emplace_back(), r);
+    });
+
+    // try to reduce edge-node crossings. the first candidate with the
+    // fewest crossings wins, so a candidate is dropped as soon as it
+    // cannot do better, and nothing beats zero crossings.
+    SegmentBatch segments;
+    std::uint32_t hit_masks[SegmentBatch::CAPACITY];
+    std::size_t best = 0;
+    std::size_t min_cross = std::numeric_limits<std::size_t>::max();
+    for(std::size_t k = 0; k < candidate_curves.size() && min_cross > 0; ++k)
+    {
+        FITNESS_PROFILE_COUNT(heuristic_candidates, 1);
+        auto &curve = candidate_curves[k];
+        segments.assignPolyline(curve.points);
+        std::size_t cross = 0;
+        for(std::size_t j = 0; j < routing_nodes.size(); ++j)
+        {
+            // the curve cannot intersect with this node
+            if(!curve.bbox.intersects(routing_nodes[j]))
+            {
+                FITNESS_PROFILE_COUNT(bbox_rejects, 1);
+                continue;
+            }
+            FITNESS_PROFILE_COUNT(segment_tests, CURVE_NODE_SEGMENT_TESTS);
+            const auto x = intersectSegmentBatches(
+                segments, routing_node_edges[j],
+                // don't count line beginning and ending as crossings
+                curve.points.front(),
+                curve.points.back(),
+                hit_masks
+            );
+            if((cross += x) >= min_cross)
+                break;
+        }
+        if(cross < min_cross)
+        {
+            best = k;
+            min_cross = cross;
+        }
+    }
+
+    curves[m] = candidate_curves[best];
+    terms.factor_a = curves[m].factor_a;
+    terms.factor_b = curves[m].factor_b;
+    terms.node_crossings = static_cast<std::uint32_t>(min_cross);
+}
+
+void PortGraphFitness::prepareTerms(PortGraphIndividual &g)
+{
+    const auto link_count = g.graph.base_graph->links.size();
+    curves.resize(link_count);
+    g.cache.links.resize(link_count);
+    mapLinkEndPoints(g);
+    node_grid.rebuild(g.graph);
+}
+
+std::size_t PortGraphFitness::countOverlaps(const PortGraphIndividual &g)
+{
+    const auto node_count = g.graph.base_graph->nodes.size();
+    std::size_t overlaps = 0;
+    for(std::size_t i = 0; i < node_count; ++i)
+    {
+        auto r0 = g.graph.mapNodeRegion(i);
+        // only test the neighbours sharing grid cells with this node
+        node_grid.query(r0, [&](const std::size_t j) {
+            // count each pair once
+            if(j <= i) return;
+            if(nodesOverlap(r0, g.graph.mapNodeRegion(j)))
+                ++overlaps;
+        });
+    }
+    return overlaps;
+}
+
+void PortGraphFitness::measureLinks(PortGraphIndividual &g)
+{
+    for(std::size_t i = 0; i < g.cache.links.size(); ++i)
+        measureLink(g, i);
+}
+
+void PortGraphFitness::routeLinks(PortGraphIndividual &g)
+{
+    for(std::size_t m = 0; m < g.cache.links.size(); ++m)
+        routeLink(g, m);
+}
+
+std::size_t PortGraphFitness::countEdgeCrossings(const std::size_t limit)
+{
+    // only test the curves whose bounding boxes overlap
+    findOverlappingCurves();
+    std::size_t crossings = 0;
+    std::size_t tested = 0;
+    for(auto &&[i, j] : curve_pairs)
+    {
+        ++tested;
+        crossings += countCurveCrossings(curves[i], curves[j], nullptr);
+        if(crossings > limit) break;
+    }
+    FITNESS_PROFILE_COUNT(segment_tests, tested * CURVE_CURVE_SEGMENT_TESTS);
+    return crossings;
+}
+
+bool PortGraphFitness::evaluateTerms(
+    PortGraphIndividual &g,
+    const FitnessT bound)
+{
+    auto &cache = g.cache;
+    const auto node_count = g.graph.base_graph->nodes.size();
+    const bool bounded = bound > std::numeric_limits<FitnessT>::lowest();
+    // the fitness evaluated so far, which the remaining crossings can only
+    // lower
+    FitnessT estimate = 0;
+    const auto stop = [&]() {
+        FITNESS_PROFILE_COUNT(early_exits, 1);
+        // the cache is incomplete and can't be updated incrementally
+        cache.valid = false;
+        g.partial = true;
+        return false;
+    };
+    g.partial = false;
+
+    {
+        FITNESS_PROFILE_TIME(PREPARE);
+        prepareTerms(g);
+    }
+    // calculate overlapped area
+    {
+        FITNESS_PROFILE_TIME(OVERLAP);
+        cache.overlaps = countOverlaps(g);
+    }
+    // measure angles and edge directions
+    {
+        FITNESS_PROFILE_TIME(LINK_MEASURE);
+        measureLinks(g);
+    }
+    if(bounded)
+    {
+        // everything but the crossings is known now
+        for(auto &&l : cache.links)
+            l.node_crossings = 0;
+        cache.edge_crossings = 0;
+        estimate = sumTerms(g);
+        if(estimate < bound) return stop();
+    }
+    // pick the curves with fewest edge-node crossings
+    {
+        FITNESS_PROFILE_TIME(ROUTING);
+        if(!bounded)
+        {
+            routeLinks(g);
+        }
+        else
+        {
+            for(std::size_t m = 0; m < cache.links.size(); ++m)
+            {
+                routeLink(g, m);
+                g.f_link_node_crossing += edge_node_crossing_penalty *
+                    cache.links[m].node_crossings;
+                estimate += edge_node_crossing_penalty *
+                    cache.links[m].node_crossings;
+                if(estimate < bound) return stop();
+            }
+        }
+    }
+    {
+        FITNESS_PROFILE_TIME(EDGE_CROSSING);
+        // # of crossings that keeps the fitness within the bound
+        std::size_t allowed = std::numeric_limits<std::size_t>::max();
+        if(bounded && edge_crossing_penalty < 0)
+        {
+            // clamp before the cast, a bound far below the estimate or a
+            // tiny penalty exceed the range of size_t. the comparison is
+            // also false for NaN, which leaves the count unbounded.
+            const double room = (static_cast<double>(estimate) - bound) /
+                -edge_crossing_penalty;
+            if(room < static_cast<double>(allowed))
+                allowed = room > 0 ? static_cast<std::size_t>(room) : 0;
+        }
+        cache.edge_crossings = countEdgeCrossings(allowed);
+        if(cache.edge_crossings > allowed)
+        {
+            g.f_link_crossing = edge_crossing_penalty * cache.edge_crossings;
+            return stop();
+        }
+    }
+
+    cache.node_positions.assign(
+        g.graph.node_positions, g.graph.node_positions + node_count);
+    cache.heuristic = heuristic;
+    cache.valid = true;
+    return true;
+}
+
+bool PortGraphFitness::updateTerms(PortGraphIndividual &g)
+{
+    using node_graph::NodeGraphInstance;
+    using node_graph::NodeGrid;
+
+    auto *base_graph = g.graph.base_graph;
+    auto &cache = g.cache;
+
+    const auto node_count = base_graph->nodes.size();
+    const auto link_count = base_graph->links.size();
+    if(!cache.valid || cache.heuristic != heuristic
+        || cache.node_positions.size() != node_count
+        || cache.links.size() != link_count)
+        return false;
+
+    // find the nodes moved since last evaluation
+    changed_nodes.assign(node_count, 0);
+    changed_node_list.clear();
+    for(std::size_t i = 0; i < node_count; ++i)
+    {
+        if(g.graph.node_positions[i] != cache.node_positions[i])
+        {
+            changed_nodes[i] = 1;
+            changed_node_list.push_back(static_cast<std::uint32_t>(i));
+        }
+    }
+    // too many changes, a full evaluation is cheaper
+    if(changed_node_list.size() > incremental_threshold * node_count)
+        return false;
+
+    if(changed_node_list.empty())
+        return true;
+
+    const NodeGraphInstance previous {
+        base_graph, cache.node_positions.data()
+    };
+    // the workspace may hold the curves of another individual
+    buildCurves(previous, cache);
+    mapLinkEndPoints(g);
+    node_grid.rebuild(g.graph);
+    previous_node_grid.rebuild(previous);
+
+    // update overlapped pairs involving moved nodes. pairs of two moved
+    // nodes are counted from the one with smaller index.
+    for(auto &&i : changed_node_list)
+    {
+        const auto count_overlaps = [&](
+            const NodeGraphInstance &layout,
+            NodeGrid &index) {
+            std::size_t overlaps = 0;
+            const auto r0 = layout.mapNodeRegion(i);
+            index.query(r0, [&](const std::size_t j) {
+                if(j == i || (changed_nodes[j] && j < i)) return;
+                if(nodesOverlap(r0, layout.mapNodeRegion(j)))
+                    ++overlaps;
+            });
+            return overlaps;
+        };
+        cache.overlaps -= count_overlaps(previous, previous_node_grid);
+        cache.overlaps += count_overlaps(g.graph, node_grid);
+    }
+
+    // re-route the links attached to moved nodes, or whose candidate curves
+    // may pass through a moved node at its old or new position. remember
+    // the old curves of those actually changed for updating crossings.
+    rerouted_links.assign(link_count, 0);
+    rerouted_link_list.clear();
+    previous_curves.clear();
+    for(std::size_t m = 0; m < link_count; ++m)
+    {
+        auto &l = base_graph->link(m);
+        if(changed_nodes[l.node0] || changed_nodes[l.node1])
+        {
+            measureLink(g, m);
+        }
+        else
+        {
+            const auto region = getRoutingRegion(
+                link_ends0[m], link_ends1[m]);
+            bool affected = false;
+            const auto touches = [&](
+                const NodeGraphInstance &layout,
+                NodeGrid &index) {
+                index.query(region, [&](const std::size_t j) {
+                    affected = affected || (changed_nodes[j] &&
+                        region.intersects(layout.mapNodeRegion(j)));
+                });
+            };
+            touches(g.graph, node_grid);
+            touches(previous, previous_node_grid);
+            if(!affected) continue;
+        }
+        const auto previous_curve = curves[m];
+        routeLink(g, m);
+        if(curves[m].points != previous_curve.points)
+        {
+            previous_curves.push_back(previous_curve);
+            rerouted_link_list.push_back(static_cast<std::uint32_t>(m));
+            // slot + 1 of the old curve
+            rerouted_links[m] = static_cast<std::uint32_t>(
+                previous_curves.size());
+        }
+    }
+
+    // update crossings between the rerouted curves and all other curves.
+    // pairs of two rerouted curves are counted from the one with smaller
+    // index.
+    const auto pair_crossings = [this](
+        const PortGraphIndividual::BezierInfo &a, const std::size_t ia,
+        const PortGraphIndividual::BezierInfo &b, const std::size_t ib)
+        -> std::size_t {
+        if(!a.bbox.intersects(b.bbox))
+        {
+            FITNESS_PROFILE_COUNT(bbox_rejects, 1);
+            return 0;
+        }
+        FITNESS_PROFILE_COUNT(segment_tests, CURVE_CURVE_SEGMENT_TESTS);
+        // keep the same order as in full evaluation
+        return ia < ib
+            ? countCurveCrossings(a, b, nullptr)
+            : countCurveCrossings(b, a, nullptr);
+    };
+    for(std::size_t k = 0; k < rerouted_link_list.size(); ++k)
+    {
+        const auto i = rerouted_link_list[k];
+        auto &old_curve = previous_curves[k];
+        auto &new_curve = curves[i];
+        for(std::size_t j = 0; j < link_count; ++j)
+        {
+            const auto slot = rerouted_links[j];
+            if(j == i || (slot && j < i)) continue;
+            auto &old_other = slot
+                ? previous_curves[slot - 1]
+                : curves[j];
+            auto &new_other = curves[j];
+            cache.edge_crossings -= pair_crossings(old_curve, i, old_other, j);
+            cache.edge_crossings += pair_crossings(new_curve, i, new_other, j);
+        }
+    }
+
+    cache.node_positions.assign(
+        g.graph.node_positions, g.graph.node_positions + node_count);
+    return true;
+}
+
+PortGraphFitness::FitnessT PortGraphFitness::sumTerms(PortGraphIndividual &g)
+{
+    auto &cache = g.cache;
+
+    g.f_overlap = node_overlap_penalty * cache.overlaps;
+    g.f_link_pos = 0;
+    g.f_link_angle = 0;
+    g.f_link_crossing = edge_crossing_penalty * cache.edge_crossings;
+    g.f_link_node_crossing = 0;
+    g.c_angle = 0;
+    g.c_invert_pos = 0;
+    for(auto &&l : cache.links)
+    {
+        // output port is to the left of input port
+        g.f_link_pos += std::min(l.dx, p_min_pos_x);
+        if(l.dx < p_min_pos_x)
+            ++g.c_invert_pos;
+        // prefer smaller angle
+        g.f_link_angle -= std::max(p_max_angle, l.angle);
+        if(l.angle > p_max_angle)
+            ++g.c_angle;
+        g.f_link_node_crossing += l.node_crossings * edge_node_crossing_penalty;
+    }
+
+    const float fit = g.f_overlap
+        + g.f_link_pos
+        + g.f_link_angle
+        + g.f_link_crossing
+        + g.f_link_node_crossing;
+    /*for(auto &&l : base_graph->links)
+    {
+        auto [n0, p0, n1, p1] = base_graph->mapLink(l);
+
+        auto r0 =
+
+        // f -= std::abs((pos0 - pos1).norm() - 100.f);
+        // // f -= (p1 - p0).norm();
+        // f -= std::abs((pos1 - pos0).dot(Vector2f::UnitY()));
+        // prefer
+
+        Vector2f edge_diff = pos1 - pos0;
+        Vector2f normalized_edge = edge_diff.normalized();
+        // normalized edge direction using dot product. prefer edge towards
+        // right.
+        const auto edge_direction = normalized_edge.dot(Vector2f::UnitX());
+        // prefer given edge length
+        const auto edge_length = -std::pow(edge_diff.norm() - 300.f, 2.f) + 1;
+        fit += w_dir * edge_direction
+            + w_length * edge_length;
+    }*/
+    return fit;
+}
+
+void PortGraphFitness::inherit(
+    PortGraphIndividual &offspring,
+    const PortGraphIndividual &parent)
+{
+    if(&offspring == &parent) return;
+
+    offspring.genotype = parent.genotype;
+    offspring.graph.base_graph = parent.graph.base_graph;
+    offspring.graph.node_positions = reinterpret_cast<Vector2f*>(
+        offspring.genotype.data());
+    offspring.cache = parent.cache;
+}
+
+PortGraphFitness::FitnessT PortGraphFitness::evaluate(
+    PortGraphIndividual &g,
+    const bool allow_incremental,
+    const FitnessT bound)
+{
+    // centers graph
+    if(center_graph)
+    {
+        const auto center = g.graph.base_graph->size.x() * 0.5f;
+        const auto sum = std::accumulate(
+            g.genotype.begin(), g.genotype.end(), 0.f);
+        const auto mean = sum / g.genotype.size();
+        std::transform(
+            g.genotype.begin(), g.genotype.end(),
+            g.genotype.begin(),
+            [=](float v) { return v - mean + center; });
+    }
+
+    if(grid != 1)
+    {
+        std::transform(
+            g.genotype.begin(), g.genotype.end(),
+            g.genotype.begin(),
+            [this](float v) { return std::floor(v / grid) * grid; });
+    }
+
+    // only re-measure what changed since the last evaluation if possible
+    bool updated = false;
+    if(allow_incremental)
+    {
+        FITNESS_PROFILE_TIME(INCREMENTAL);
+        updated = updateTerms(g);
+    }
+    if(updated)
+    {
+        FITNESS_PROFILE_COUNT(incremental_evaluations, 1);
+        g.partial = false;
+    }
+    else
+    {
+        FITNESS_PROFILE_COUNT(full_evaluations, 1);
+        if(!evaluateTerms(g, bound))
+        {
+            // the terms were summed while being measured
+            return g.f_overlap + g.f_link_pos + g.f_link_angle
+                + g.f_link_crossing + g.f_link_node_crossing;
+        }
+    }
+
+    return sumTerms(g);
+}
+
+void PortGraphFitness::traceLayout(
+    const PortGraphIndividual &g,
+    const bool collect_crossings)
+{
+    assert(g.cache.valid);
+    buildCurves(g.graph, g.cache);
+    crosses.clear();
+    if(!collect_crossings) return;
+
+    node_grid.rebuild(g.graph);
+    for(auto &&curve : curves)
+        countNodeEdgeCrossings(g, curve, &crosses);
+    findOverlappingCurves();
+    for(auto &&[i, j] : curve_pairs)
+        countCurveCrossings(curves[i], curves[j], &crosses);
+}
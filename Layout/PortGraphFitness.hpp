@@ -0,0 +1,373 @@
+﻿#pragma once
+
+#include <vector>
+#include <array>
+#include <tuple>
+#include <cstdint>
+#include <limits>
+
+#include <GraphLayout/Core/Math.hpp>
+#include <GraphLayout/Graph/NodeGraph.hpp>
+#include <GraphLayout/Graph/NodeGrid.hpp>
+#include <GraphLayout/Graph/SegmentIntersection.hpp>
+#include <GraphLayout/Genetic/GeneticOptimizer.hpp>
+#include <GraphLayout/Genetic/ParentSelection.hpp>
+#include <GraphLayout/Genetic/Crossover.hpp>
+#include <GraphLayout/Genetic/Mutation.hpp>
+#include <GraphLayout/Genetic/Replacement.hpp>
+#include <GraphLayout/Genetic/StopCondition.hpp>
+
+#include "PortGraphSeed.hpp"
+
+// collect the timings and counters of FitnessProfile. define to 0 to
+// compile the instrumentation out.
+#ifndef GRAPHLAYOUT_FITNESS_PROFILE
+#   define GRAPHLAYOUT_FITNESS_PROFILE 1
+#endif
+
+namespace usagi
+{
+struct PortGraphIndividual : genetic::Individual<std::vector<float>, float>
+{
+    node_graph::NodeGraphInstance graph;
+
+    float f_overlap = 0;
+    float f_link_pos = 0;
+    float f_link_angle = 0;
+    float f_link_crossing = 0;
+    float f_link_node_crossing = 0;
+    int c_angle = 0;
+    int c_invert_pos = 0;
+
+    // the curves and crossings are not kept by the individual. they are
+    // rebuilt into the workspace of PortGraphFitness when needed.
+    static constexpr std::size_t BEZIER_SEGMENT_COUNT = 6;
+    static constexpr std::size_t BEZIER_POINT_COUNT = BEZIER_SEGMENT_COUNT + 1;
+    struct BezierInfo
+    {
+        std::array<Vector2f, BEZIER_POINT_COUNT> points;
+        AlignedBox2f bbox;
+        float factor_a = 0;
+        float factor_b = 0;
+    };
+
+    // raw measurements of the last evaluation, kept so that an offspring
+    // only has to re-measure what was touched by crossover or mutation.
+    struct LinkTerms
+    {
+        // horizontal distance from the output port to the input port
+        float dx = 0;
+        // angle from the x axis, in degrees
+        float angle = 0;
+        std::uint32_t node_crossings = 0;
+        // control factors of the curve chosen by the routing heuristic
+        float factor_a = 0;
+        float factor_b = 0;
+    };
+    struct EvaluationCache
+    {
+        bool valid = false;
+        bool heuristic = false;
+        std::vector<Vector2f> node_positions;
+        std::vector<LinkTerms> links;
+        std::size_t overlaps = 0;
+        std::size_t edge_crossings = 0;
+    } cache;
+};
+
+/**
+ * \brief Time spent in each term of the fitness function and how much work
+ * the crossing tests did. Only collected if GRAPHLAYOUT_FITNESS_PROFILE is
+ * enabled, otherwise stays zero.
+ */
+struct FitnessProfile
+{
+    enum Term
+    {
+        // mapping link end points and indexing node regions
+        PREPARE,
+        OVERLAP,
+        LINK_MEASURE,
+        ROUTING,
+        EDGE_CROSSING,
+        // the whole update of an incrementally evaluated individual
+        INCREMENTAL,
+        TERM_COUNT
+    };
+    static constexpr const char *TERM_NAMES[TERM_COUNT] = {
+        "prepare", "overlap", "link_measure",
+        "routing", "edge_crossing", "incremental"
+    };
+
+    std::uint64_t nanoseconds[TERM_COUNT] { };
+    std::uint64_t full_evaluations = 0;
+    std::uint64_t incremental_evaluations = 0;
+    // segment pairs tested for intersection
+    std::uint64_t segment_tests = 0;
+    // curve-node and curve-curve pairs culled by bounding boxes
+    std::uint64_t bbox_rejects = 0;
+    // candidate curves tried by the routing heuristic
+    std::uint64_t heuristic_candidates = 0;
+    // full evaluations stopped by the lower bound
+    std::uint64_t early_exits = 0;
+
+    std::uint64_t evaluations() const
+    {
+        return full_evaluations + incremental_evaluations;
+    }
+
+    FitnessProfile & operator+=(const FitnessProfile &other)
+    {
+        for(std::size_t i = 0; i < TERM_COUNT; ++i)
+            nanoseconds[i] += other.nanoseconds[i];
+        full_evaluations += other.full_evaluations;
+        incremental_evaluations += other.incremental_evaluations;
+        segment_tests += other.segment_tests;
+        bbox_rejects += other.bbox_rejects;
+        heuristic_candidates += other.heuristic_candidates;
+        early_exits += other.early_exits;
+        return *this;
+    }
+};
+
+/**
+ * \brief The settings of PortGraphFitness, kept apart from its workspace so
+ * that they can be copied to the worker threads on their own.
+ */
+struct PortGraphFitnessParameters
+{
+    bool heuristic = true;
+    bool center_graph = false;
+    int grid = 1;
+    float p_max_angle = 60;
+    float p_min_pos_x = 50;
+
+    float node_overlap_penalty = -1000;
+    float edge_crossing_penalty = -100;
+    float edge_node_crossing_penalty = -100;
+
+    // when enabled, individuals with a valid cache only get the nodes and
+    // links changed since their last evaluation re-measured.
+    bool incremental = true;
+    // fall back to full evaluation if more nodes than this fraction moved
+    float incremental_threshold = 0.5f;
+};
+
+struct PortGraphFitness : PortGraphFitnessParameters
+{
+    using FitnessT = float;
+    using ParametersT = PortGraphFitnessParameters;
+
+    // spatial index of the individual being evaluated. rebuilt at the
+    // beginning of each evaluation and used by the overlap and edge-node
+    // crossing tests.
+    node_graph::NodeGrid node_grid;
+
+    // workspace of the individual being evaluated. each thread evaluates
+    // with its own copy of the fitness function, so the individuals don't
+    // have to carry these around.
+    std::vector<PortGraphIndividual::BezierInfo> curves;
+    // only filled by traceLayout()
+    std::vector<Vector2f> crosses;
+    // end points of all links, computed in one pass over the genotype
+    std::vector<Vector2f> link_ends0, link_ends1;
+
+    // routing heuristic scratch: nodes near the candidate curves of a link
+    std::vector<AlignedBox2f> routing_nodes;
+    std::vector<node_graph::SegmentBatch> routing_node_edges;
+
+    // incremental evaluation scratch
+    node_graph::NodeGrid previous_node_grid;
+    std::vector<std::uint8_t> changed_nodes;
+    std::vector<std::uint32_t> changed_node_list;
+    std::vector<std::uint32_t> rerouted_links;
+    std::vector<std::uint32_t> rerouted_link_list;
+    std::vector<PortGraphIndividual::BezierInfo> previous_curves;
+
+    // broad phase of edge crossing test. pairs of links whose bezier
+    // bounding boxes overlap, found by sweep-and-prune.
+    std::vector<std::uint32_t> curve_order;
+    std::vector<std::uint32_t> active_curves;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> curve_pairs;
+
+    // accumulated over all evaluations by this copy of the fitness function.
+    // GeneticOptimizer clears it when initializing the population and
+    // merges the copies of its worker threads into it.
+    FitnessProfile profile;
+    FitnessProfile & statistics() { return profile; }
+    const FitnessProfile & statistics() const { return profile; }
+
+    void findOverlappingCurves();
+    std::size_t countNodeEdgeCrossings(
+        const PortGraphIndividual &g,
+        const PortGraphIndividual::BezierInfo &curve,
+        std::vector<Vector2f> *crosses);
+    void buildCurves(
+        const node_graph::NodeGraphInstance &layout,
+        const PortGraphIndividual::EvaluationCache &cache);
+    void mapLinkEndPoints(const PortGraphIndividual &g);
+    void measureLink(PortGraphIndividual &g, std::size_t link_idx);
+    void routeLink(PortGraphIndividual &g, std::size_t link_idx);
+
+    // stages of a full evaluation, in order. each stage only reads what
+    // the previous ones left in the workspace, so they can be timed
+    // separately.
+
+    /**
+     * \brief Size the workspace for g, map the link end points and index
+     * the node regions.
+     */
+    void prepareTerms(PortGraphIndividual &g);
+    std::size_t countOverlaps(const PortGraphIndividual &g);
+    void measureLinks(PortGraphIndividual &g);
+    void routeLinks(PortGraphIndividual &g);
+    /**
+     * \brief Count the crossings among the curves left by routeLinks(). Stops
+     * counting once more than limit crossings are found.
+     */
+    std::size_t countEdgeCrossings(
+        std::size_t limit = std::numeric_limits<std::size_t>::max());
+
+    /**
+     * \brief Measure all terms of g. If the fitness is found to be below
+     * bound before all terms are measured, the evaluation stops, g is marked
+     * partial and false is returned.
+     */
+    bool evaluateTerms(
+        PortGraphIndividual &g,
+        FitnessT bound = std::numeric_limits<FitnessT>::lowest());
+    bool updateTerms(PortGraphIndividual &g);
+    FitnessT sumTerms(PortGraphIndividual &g);
+
+    /**
+     * \brief Copy the genes of parent into offspring along with the cached
+     * evaluation, so the offspring can be evaluated incrementally.
+     */
+    void inherit(
+        PortGraphIndividual &offspring,
+        const PortGraphIndividual &parent);
+    /**
+     * \brief Evaluate g. Every term is a penalty except f_link_pos, which is
+     * capped at p_min_pos_x per link, so the fitness can only decrease as the
+     * crossings are counted. Once it drops below bound the evaluation stops
+     * and an upper bound of the fitness is returned, with g.partial set.
+     * Incremental updates are always completed.
+     */
+    FitnessT evaluate(
+        PortGraphIndividual &g,
+        bool allow_incremental,
+        FitnessT bound = std::numeric_limits<FitnessT>::lowest());
+    FitnessT operator()(PortGraphIndividual &g)
+    {
+        return evaluate(g, incremental);
+    }
+    FitnessT operator()(PortGraphIndividual &g, const FitnessT bound)
+    {
+        return evaluate(g, incremental, bound);
+    }
+
+    /**
+     * \brief Rebuild the curves chosen by the last evaluation of g into
+     * curves, and optionally collect all crossings into crosses.
+     */
+    void traceLayout(const PortGraphIndividual &g, bool collect_crossings);
+};
+
+struct PortGraphPopulationGenerator
+{
+    node_graph::NodeGraph prototype;
+    std::uniform_real_distribution<float> domain { 0, 1 };
+
+    // fraction of the individuals created by relaxing a random layout with
+    // seed_layout instead of uniformly at random. off by default: seeds are
+    // fitter but less diverse, so the rest stays uniform when enabled.
+    float seeded_fraction = 0;
+    PortGraphSeedLayout seed_layout;
+
+    /**
+     * \brief An individual of the size of prototype whose genes are left
+     * zero, for callers that fill them in themselves.
+     */
+    PortGraphIndividual createEmpty()
+    {
+        PortGraphIndividual individual;
+        individual.genotype.resize(prototype.nodes.size() * 2);
+        individual.graph.base_graph = &prototype;
+        individual.graph.node_positions = reinterpret_cast<Vector2f*>(
+            individual.genotype.data());
+        return individual;
+    }
+
+    template <typename Optimizer>
+    PortGraphIndividual operator()(Optimizer &o)
+    {
+        auto individual = createEmpty();
+        std::uniform_real_distribution<float> chance;
+        // don't draw from rng unless seeding, so unseeded populations stay
+        // the same as before
+        if(seeded_fraction > 0 && chance(o.rng) < seeded_fraction)
+        {
+            createSeed(individual.genotype, o.rng);
+        }
+        else
+        {
+            std::generate(
+                individual.genotype.begin(), individual.genotype.end(),
+                // use ref for rng to prevent being copied
+                std::bind(domain, std::ref(o.rng))
+            );
+        }
+        return individual;
+    }
+
+    /**
+     * \brief Relax a random layout with seed_layout, center it in the domain
+     * and clamp the genes into it. Every seed starts from its own random
+     * layout, so that the seeded individuals are not clones.
+     */
+    template <typename Rng>
+    void createSeed(std::vector<float> &genes, Rng &rng)
+    {
+        std::generate(genes.begin(), genes.end(),
+            std::bind(domain, std::ref(rng)));
+        const auto positions = reinterpret_cast<Vector2f*>(genes.data());
+        seed_layout.relax(prototype, positions);
+
+        const node_graph::NodeGraphInstance instance { &prototype, positions };
+        AlignedBox2f bounds;
+        for(std::size_t i = 0; i < prototype.nodes.size(); ++i)
+            bounds.extend(instance.mapNodeRegion(i));
+        const auto center = (domain.a() + domain.b()) * 0.5f;
+        const Vector2f offset =
+            Vector2f { center, center } - bounds.center();
+        for(std::size_t i = 0; i < prototype.nodes.size(); ++i)
+            positions[i] += offset;
+        for(auto &&g : genes)
+            g = std::clamp(g, domain.a(), domain.b());
+    }
+};
+
+/**
+ * \brief Control points of the bezier curve of a link from p0 to p1,
+ * translated by offset.
+ */
+std::tuple<Vector2f, Vector2f, Vector2f, Vector2f> getBezierControlPoints(
+    const Vector2f &p0,
+    const Vector2f &p1,
+    const Vector2f &offset,
+    float control_factor_a,
+    float control_factor_b);
+
+using PortGraphOptimizer = genetic::GeneticOptimizer<
+    float,
+    PortGraphFitness,
+    genetic::parent::TournamentParentSelection<5, 2>,
+    genetic::crossover::WholeArithmeticRecombination,
+    genetic::mutation::UniformRealMutation<std::vector<float>>,
+    genetic::replacement::IncrementalTournamentReplacement<10, 2>,
+    genetic::stop::SolutionConvergedStopCondition<float>,
+    PortGraphPopulationGenerator,
+    std::vector<float>,
+    PortGraphIndividual
+>;
+}
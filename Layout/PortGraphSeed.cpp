@@ -0,0 +1,67 @@
+﻿#include "PortGraphSeed.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+void usagi::PortGraphSeedLayout::relax(
+    const node_graph::NodeGraph &graph,
+    Vector2f *positions)
+{
+    const auto node_count = graph.nodes.size();
+    const auto link_count = graph.links.size();
+    assert(graph.link_node0.size() == link_count);
+    const node_graph::NodeGraphInstance instance { &graph, positions };
+
+    mMoves.resize(node_count);
+    mWeights.resize(node_count);
+    for(int it = 0; it < iterations; ++it)
+    {
+        // the springs settle with decreasing steps while the overlaps are
+        // always resolved completely
+        const auto temperature = 1.f - float(it) / iterations;
+
+        std::fill(mMoves.begin(), mMoves.end(), Vector2f::Zero());
+        std::fill(mWeights.begin(), mWeights.end(), 0.f);
+        for(std::size_t m = 0; m < link_count; ++m)
+        {
+            const auto n0 = graph.link_node0[m];
+            const auto n1 = graph.link_node1[m];
+            const auto [p0, p1] = instance.mapLinkEndPoints(m);
+            const Vector2f error = p1 - p0 - Vector2f { link_gap, 0 };
+            // both ends meet halfway
+            mMoves[n0] += error * 0.5f;
+            mMoves[n1] -= error * 0.5f;
+            mWeights[n0] += 1;
+            mWeights[n1] += 1;
+        }
+        // move each node by the average of what its links ask for
+        for(std::size_t i = 0; i < node_count; ++i)
+        {
+            if(mWeights[i] > 0)
+                positions[i] += mMoves[i] * (temperature / mWeights[i]);
+        }
+
+        mGrid.rebuild(instance);
+        for(std::size_t i = 0; i < node_count; ++i)
+        {
+            auto region = instance.mapNodeRegion(i);
+            region.min().array() -= node_margin;
+            region.max().array() += node_margin;
+            mGrid.query(region, [&](const std::size_t j) {
+                if(j <= i) return;
+                const auto other = instance.mapNodeRegion(j);
+                if(!region.intersects(other)) return;
+                // push both apart along the axis of least penetration
+                const Vector2f delta = other.center() - region.center();
+                const Vector2f depth =
+                    (region.sizes() + other.sizes()) * 0.5f
+                    - delta.cwiseAbs();
+                Vector2f push = Vector2f::Zero();
+                const int axis = depth.x() < depth.y() ? 0 : 1;
+                push[axis] = (delta[axis] < 0 ? -0.5f : 0.5f) * depth[axis];
+                positions[i] -= push;
+                positions[j] += push;
+            });
+        }
+    }
+}
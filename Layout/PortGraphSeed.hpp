@@ -0,0 +1,37 @@
+﻿#pragma once
+
+#include <vector>
+
+#include <GraphLayout/Core/Math.hpp>
+#include <GraphLayout/Graph/NodeGraph.hpp>
+#include <GraphLayout/Graph/NodeGrid.hpp>
+
+namespace usagi
+{
+/**
+ * \brief Port-aware force-directed pass producing a starting layout for the
+ * genetic optimizer. Each link pulls its input port towards a spot
+ * link_gap to the right of its output port, which prefers left-to-right
+ * links, and overlapping nodes are pushed apart. Linear in the amount of
+ * nodes and links per iteration.
+ */
+class PortGraphSeedLayout
+{
+    node_graph::NodeGrid mGrid;
+    std::vector<Vector2f> mMoves;
+    std::vector<float> mWeights;
+
+public:
+    int iterations = 100;
+    // horizontal distance preferred from an output port to the input port
+    float link_gap = 100;
+    // space kept between nodes
+    float node_margin = 80;
+
+    /**
+     * \brief Relax node positions in place, one per node of graph. The
+     * adjacency of graph must be built.
+     */
+    void relax(const node_graph::NodeGraph &graph, Vector2f *positions);
+};
+}
@@ -0,0 +1,581 @@
+﻿#include "RandomizedTest.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <tuple>
+#include <cstring>
+#include <stdexcept>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+
+#include <GraphLayout/Core/Logging.hpp>
+#include <GraphLayout/Genetic/IslandOptimizer.hpp>
+#include <GraphLayout/Genetic/Checkpoint.hpp>
+
+#include "PortGraphFitness.hpp"
+
+namespace
+{
+using namespace usagi;
+
+// evaluations, full_evaluations, nanoseconds of each term,
+// segment_tests, bbox_rejects, heuristic_candidates
+std::string formatProfileColumns(const FitnessProfile &profile)
+{
+    return fmt::format("{}, {}, {}, {}, {}, {}",
+        profile.evaluations(),
+        profile.full_evaluations,
+        fmt::join(std::begin(profile.nanoseconds),
+            std::end(profile.nanoseconds), ", "),
+        profile.segment_tests,
+        profile.bbox_rejects,
+        profile.heuristic_candidates);
+}
+
+// columns of the task in the CSV rows. columns are only ever appended, so
+// that older campaigns stay readable.
+constexpr std::size_t CSV_GRAPH_COLUMN = 32;
+constexpr std::size_t CSV_REPEAT_COLUMN = 33;
+constexpr std::size_t CSV_SEED_COLUMN = 35;
+
+using Islands = genetic::IslandOptimizer<PortGraphOptimizer>;
+
+constexpr char CHECKPOINT_MAGIC[4] = { 'G', 'L', 'T', 'C' };
+constexpr std::uint32_t CHECKPOINT_VERSION = 2;
+
+/**
+ * \brief The settings of RandomTestConfig shaping an optimization, stored
+ * in checkpoints so that a run is never resumed with other settings. Only
+ * 32-bit fields, so that there is no padding to compare.
+ */
+struct CheckpointConfig
+{
+    std::int32_t population = 0;
+    std::int32_t pin_amount = 0;
+    float pin_connection_rate = 0;
+    float canvas_size_per_node = 0;
+    std::uint32_t heuristic = 0;
+    std::uint32_t bounded_evaluation = 0;
+    float seeded_fraction = 0;
+    std::int32_t batch_size = 0;
+    std::int32_t islands = 0;
+    std::int32_t migration_interval = 0;
+    std::int32_t migration_size = 0;
+    std::uint32_t fully_connected_migration = 0;
+    float stop_threshold = 0;
+    std::uint32_t stop_period = 0;
+
+    explicit CheckpointConfig(const RandomTestConfig &config)
+        : population(config.population)
+        , pin_amount(config.pin_amount)
+        , pin_connection_rate(config.pin_connection_rate)
+        , canvas_size_per_node(config.canvas_size_per_node)
+        , heuristic(config.heuristic)
+        , bounded_evaluation(config.bounded_evaluation)
+        , seeded_fraction(config.seeded_fraction)
+        , batch_size(config.batch_size)
+        , islands(config.islands)
+        , migration_interval(config.migration_interval)
+        , migration_size(config.migration_size)
+        , fully_connected_migration(config.fully_connected_migration)
+        , stop_threshold(config.stop.significant_improvement_threshold)
+        , stop_period(config.stop.significant_improvement_period)
+    {
+    }
+
+    CheckpointConfig() = default;
+
+    bool operator==(const CheckpointConfig &other) const
+    {
+        return std::memcmp(this, &other, sizeof(*this)) == 0;
+    }
+};
+static_assert(sizeof(CheckpointConfig) == 14 * 4);
+
+/**
+ * \brief Save the optimizer of task, or its islands if not null, along with
+ * the settings it runs with, the time spent and the fitness profile so far.
+ * The snapshot is written to a temporary file first, so a crash never leaves
+ * a truncated checkpoint.
+ */
+void writeCheckpoint(
+    const std::filesystem::path &path,
+    const RandomTestConfig &config,
+    const RandomTestTask &task,
+    const double time,
+    const Islands *islands,
+    const PortGraphOptimizer &optimizer)
+{
+    using namespace genetic::checkpoint;
+
+    auto temp = path;
+    temp += ".tmp";
+    {
+        std::ofstream out { temp, std::ios::binary };
+        out.exceptions(std::ios::badbit | std::ios::failbit);
+        out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        writeValue(out, CHECKPOINT_VERSION);
+        writeValue(out, task);
+        writeValue(out, CheckpointConfig(config));
+        writeValue(out, time);
+        writeValue(out, islands
+            ? islands->fitnessStatistics()
+            : optimizer.fitness.statistics());
+        if(islands)
+        {
+            writeValue(out, static_cast<std::uint32_t>(
+                islands->islands.size()));
+            for(auto &&island : islands->islands)
+                writeOptimizer(out, island);
+        }
+        else
+        {
+            writeValue(out, std::uint32_t(1));
+            writeOptimizer(out, optimizer);
+        }
+    }
+    std::filesystem::rename(temp, path);
+}
+
+/**
+ * \brief Restore a checkpoint written by writeCheckpoint() for the same task
+ * into an optimizer configured for it, or create the islands from it if
+ * islands is not null. Returns the time spent before the checkpoint. Throws
+ * std::runtime_error if the checkpoint belongs to another task or
+ * configuration.
+ */
+double readCheckpoint(
+    const std::filesystem::path &path,
+    const RandomTestConfig &config,
+    const RandomTestTask &task,
+    Islands *islands,
+    PortGraphOptimizer &optimizer)
+{
+    using namespace genetic::checkpoint;
+
+    std::ifstream in { path, std::ios::binary };
+    if(!in)
+        throw std::runtime_error("Failed to open checkpoint");
+    char magic[sizeof(CHECKPOINT_MAGIC)];
+    if(!in.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 ||
+        readValue<std::uint32_t>(in) != CHECKPOINT_VERSION)
+        throw std::runtime_error("Not a checkpoint of this version");
+    const auto saved = readValue<RandomTestTask>(in);
+    if(std::tie(saved.node_amount, saved.graph, saved.repeat,
+        saved.graph_seed, saved.seed) != std::tie(task.node_amount,
+            task.graph, task.repeat, task.graph_seed, task.seed))
+        throw std::runtime_error("Checkpoint of another task");
+    if(!(readValue<CheckpointConfig>(in) == CheckpointConfig(config)))
+        throw std::runtime_error("Checkpoint of another configuration");
+    const auto time = readValue<double>(in);
+    const auto profile = readValue<FitnessProfile>(in);
+    const auto count = readValue<std::uint32_t>(in);
+    if(count != (islands ? std::uint32_t(config.islands) : 1))
+        throw std::runtime_error("Island count mismatch");
+
+    if(islands)
+    {
+        islands->createIslands(optimizer, count);
+        for(auto &&island : islands->islands)
+            readOptimizer(in, island);
+        islands->islands.front().fitness.statistics() += profile;
+    }
+    else
+    {
+        readOptimizer(in, optimizer);
+        optimizer.fitness.statistics() += profile;
+    }
+    return time;
+}
+
+using TaskKey = std::tuple<int, int, int, std::uint32_t>;
+
+/**
+ * \brief Collect the tasks recorded in a CSV file written by
+ * performRandomizedTests().
+ */
+void readFinishedTasks(const std::filesystem::path &path,
+    std::set<TaskKey> &finished)
+{
+    std::ifstream csv { path };
+    std::string line;
+    std::vector<std::string> fields;
+    while(std::getline(csv, line))
+    {
+        fields.clear();
+        std::istringstream row { line };
+        for(std::string f; std::getline(row, f, ',');)
+            fields.push_back(std::move(f));
+        if(fields.size() <= CSV_SEED_COLUMN) continue;
+        try
+        {
+            finished.emplace(
+                std::stoi(fields[0]),
+                std::stoi(fields[CSV_GRAPH_COLUMN]),
+                std::stoi(fields[CSV_REPEAT_COLUMN]),
+                static_cast<std::uint32_t>(
+                    std::stoul(fields[CSV_SEED_COLUMN])));
+        }
+        catch(const std::exception &)
+        {
+            // incomplete line left by a crash
+        }
+    }
+}
+}
+
+void usagi::createTestNodes(
+    node_graph::NodeGraph &graph,
+    const int node_amount,
+    const int pin_amount)
+{
+    assert(node_amount > 0);
+    assert(pin_amount > 0);
+
+    graph.links.clear();
+    graph.nodes.clear();
+    graph.prototypes.clear();
+    // create one prototype which we will use through out the test
+    graph.prototypes.emplace_back(
+        std::string {}, Vector2f { 100, 100 }, pin_amount, pin_amount);
+    // insert nodes
+    graph.nodes.assign(
+        node_amount, { &graph.prototypes.front(), std::string {} }
+    );
+}
+
+void usagi::createRandomLinks(
+    node_graph::NodeGraph &graph,
+    const int link_count,
+    std::mt19937 &rng)
+{
+    assert(link_count >= 0);
+    assert(!graph.nodes.empty());
+    auto &proto = graph.prototypes.front();
+    std::uniform_int_distribution<std::size_t> node_dist {
+        0, graph.nodes.size() - 1
+    };
+    std::uniform_int_distribution<std::size_t> out_pin_dist {
+        0, proto.out_ports.size() - 1
+    };
+    std::uniform_int_distribution<std::size_t> in_pin_dist {
+        0, proto.in_ports.size() - 1
+    };
+
+    graph.links.clear();
+    graph.links.reserve(link_count);
+    for(int j = 0; j < link_count; ++j)
+    {
+        // keep the order of evaluation fixed so that the graphs generated
+        // from the same seed are identical
+        const auto node0 = node_dist(rng);
+        const auto port0 = out_pin_dist(rng);
+        const auto node1 = node_dist(rng);
+        const auto port1 = in_pin_dist(rng);
+        graph.links.emplace_back(node0, port0, node1, port1);
+    }
+    graph.buildAdjacency();
+}
+
+std::vector<usagi::RandomTestTask> usagi::planRandomizedTests(
+    const RandomTestConfig &config)
+{
+    std::vector<RandomTestTask> tasks;
+    for(auto n = config.start_node_amount;
+        n <= config.finish_node_amount; n += config.step)
+    {
+        for(int i = 0; i < config.generation; ++i)
+        {
+            // all repeats on the same graph share the graph seed
+            std::seed_seq graph_seq {
+                config.seed, std::uint32_t(n), std::uint32_t(i), 0u
+            };
+            std::uint32_t graph_seed;
+            graph_seq.generate(&graph_seed, &graph_seed + 1);
+            for(int j = 0; j < config.repeat; ++j)
+            {
+                std::seed_seq seq {
+                    config.seed, std::uint32_t(n), std::uint32_t(i),
+                    std::uint32_t(j + 1)
+                };
+                std::uint32_t seed;
+                seq.generate(&seed, &seed + 1);
+                tasks.push_back({ n, i, j, graph_seed, seed });
+            }
+        }
+    }
+    // the run time grows steeply with the node amount. starting with the
+    // largest graphs keeps the long tasks from being left to the end.
+    std::stable_sort(tasks.begin(), tasks.end(),
+        [](const RandomTestTask &a, const RandomTestTask &b) {
+            return a.node_amount > b.node_amount;
+        });
+    return tasks;
+}
+
+std::string usagi::performRandomizedTest(
+    const RandomTestConfig &config,
+    const RandomTestTask &task,
+    const std::function<bool()> &keep_running,
+    const std::filesystem::path &checkpoint)
+{
+    assert(task.node_amount > 0);
+
+    PortGraphOptimizer optimizer;
+    auto &proto = optimizer.generator.prototype;
+    optimizer.rng.seed(task.seed);
+    optimizer.fitness.heuristic = config.heuristic;
+    optimizer.batch_size = config.batch_size;
+    optimizer.bounded_evaluation = config.bounded_evaluation;
+    optimizer.stop_condition = config.stop;
+
+    const auto canvas_size = config.canvas_size_per_node * task.node_amount;
+    // set canvas size proportionate to the amount of nodes
+    const auto domain = std::uniform_real_distribution<float> {
+        0.f, canvas_size
+    };
+    optimizer.generator.domain = domain;
+    optimizer.generator.seeded_fraction = config.seeded_fraction;
+    // proportional to canvas size of node graph
+    optimizer.mutation.domain = domain;
+
+    createTestNodes(proto, task.node_amount, config.pin_amount);
+    std::mt19937 graph_rng { task.graph_seed };
+    createRandomLinks(proto,
+        int(config.pin_connection_rate * task.node_amount), graph_rng);
+
+    genetic::IslandOptimizer<PortGraphOptimizer> islands;
+    const bool use_islands = config.islands > 1;
+    if(use_islands)
+    {
+        islands.topology = config.fully_connected_migration
+            ? genetic::MigrationTopology::FULLY_CONNECTED
+            : genetic::MigrationTopology::RING;
+        islands.migration_interval = config.migration_interval;
+        islands.migration_size = config.migration_size;
+    }
+
+    // time spent before the optimization was resumed
+    double previous_time = 0;
+    bool resumed = false;
+    if(!checkpoint.empty() && exists(checkpoint))
+    {
+        try
+        {
+            previous_time = readCheckpoint(checkpoint, config, task,
+                use_islands ? &islands : nullptr, optimizer);
+            resumed = true;
+            LOG(info, "Resumed {} at year {}", checkpoint,
+                use_islands ? islands.totalYears() : optimizer.year);
+        }
+        catch(const std::exception &e)
+        {
+            LOG(warn, "Discarding checkpoint {}: {}", checkpoint, e.what());
+        }
+    }
+    if(!resumed)
+    {
+        if(use_islands)
+            islands.initializeIslands(
+                optimizer, config.islands, config.population);
+        else
+            optimizer.initializePopulation(config.population);
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const auto begin_time = Clock::now();
+    const auto interval = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(config.checkpoint_interval));
+    const bool checkpoints = !checkpoint.empty()
+        && config.checkpoint_interval > 0;
+    auto next_checkpoint = begin_time + interval;
+    const auto elapsed = [&]() {
+        const std::chrono::duration<double> time = Clock::now() - begin_time;
+        return previous_time + time.count();
+    };
+    const auto save = [&]() {
+        writeCheckpoint(checkpoint, config, task, elapsed(),
+            use_islands ? &islands : nullptr, optimizer);
+        next_checkpoint = Clock::now() + interval;
+    };
+    const auto checkpoint_due = [&]() {
+        return checkpoints && Clock::now() >= next_checkpoint;
+    };
+    if(use_islands)
+    {
+        // the islands are paused to take the snapshots
+        while(keep_running() && !islands.stopped())
+        {
+            islands.run([&]() {
+                return keep_running() && !checkpoint_due();
+            });
+            if(checkpoint_due()) save();
+        }
+    }
+    else
+    {
+        while(keep_running() && !optimizer.stopCondition())
+        {
+            optimizer.step();
+            if(checkpoint_due()) save();
+        }
+    }
+    const auto delta_time = elapsed();
+    if(!keep_running())
+    {
+        // keep the progress for the next run
+        if(!checkpoint.empty()) save();
+        return { };
+    }
+
+    auto &result = use_islands ? islands.bestIsland() : optimizer;
+    const auto profile = use_islands
+        ? islands.fitnessStatistics()
+        : optimizer.fitness.statistics();
+    // nodes, links, unit_canvas, canvas, ports, connection_rate,
+    // population, finish_iterations, time, fitness,
+    // edge_crossings, edge_node_crossings, overlap,
+    // c_invert_pos, f_link_pos, c_angle, f_link_angle,
+    // stop_threshold, stop_period,
+    // heuristic, islands,
+    // evaluations, full_evaluations, t_prepare, t_overlap,
+    // t_link_measure, t_routing, t_edge_crossing, t_incremental,
+    // segment_tests, bbox_rejects, heuristic_candidates,
+    // graph, repeat, graph_seed, seed,
+    // early_exits, seeded_fraction
+    return fmt::format(
+        "{}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}",
+        proto.nodes.size(),
+        proto.links.size(),
+        config.canvas_size_per_node,
+        canvas_size,
+        config.pin_amount,
+        config.pin_connection_rate,
+        result.population.size(),
+        use_islands ? islands.totalYears() : result.year,
+        delta_time,
+        result.best.top()->fitness,
+        result.best.top()->f_link_crossing /
+            result.fitness.edge_crossing_penalty,
+        result.best.top()->f_link_node_crossing /
+            result.fitness.edge_node_crossing_penalty,
+        result.best.top()->f_overlap /
+            result.fitness.node_overlap_penalty,
+        result.best.top()->c_invert_pos,
+        result.best.top()->f_link_pos,
+        result.best.top()->c_angle,
+        result.best.top()->f_link_angle,
+        result.stop_condition.significant_improvement_threshold,
+        result.stop_condition.significant_improvement_period,
+        result.fitness.heuristic,
+        config.islands,
+        formatProfileColumns(profile),
+        task.graph,
+        task.repeat,
+        task.graph_seed,
+        task.seed,
+        profile.early_exits,
+        config.seeded_fraction
+    );
+}
+
+void usagi::performRandomizedTests(
+    const RandomTestConfig &config,
+    const std::filesystem::path &folder,
+    const std::function<bool()> &keep_running)
+{
+    auto tasks = planRandomizedTests(config);
+
+    // one file per node amount, shared by the threads running its tasks.
+    // the results already in the folder are kept and their tasks skipped.
+    struct CsvFile
+    {
+        std::ofstream csv;
+        std::mutex mutex;
+    };
+    std::map<int, CsvFile> files;
+    std::set<TaskKey> finished;
+    for(auto &&t : tasks)
+    {
+        auto &file = files[t.node_amount];
+        if(file.csv.is_open()) continue;
+        const auto filename =
+            folder / fmt::format("test_{}.csv", t.node_amount);
+        readFinishedTasks(filename, finished);
+        file.csv.open(filename, std::ios::app);
+        if(!file.csv)
+        {
+            LOG(error, "Falied to open: {}, aborting test.", filename);
+            return;
+        }
+    }
+    const auto planned = tasks.size();
+    tasks.erase(std::remove_if(tasks.begin(), tasks.end(),
+        [&](const RandomTestTask &t) {
+            return finished.count({
+                t.node_amount, t.graph, t.repeat, t.seed
+            }) != 0;
+        }), tasks.end());
+    if(tasks.size() < planned)
+    {
+        LOG(info, "Skipping {} tasks found in {}",
+            planned - tasks.size(), folder);
+    }
+
+    const auto checkpoint_folder = folder / "checkpoints";
+    create_directories(checkpoint_folder);
+    const auto checkpoint_path = [&](const RandomTestTask &t) {
+        return checkpoint_folder / fmt::format(
+            "task_{}_{}_{}.ckpt", t.node_amount, t.graph, t.repeat);
+    };
+
+    // each thread takes the next task when it finishes one. islands run
+    // on threads of their own, so fewer tasks run at once.
+    const auto threads = std::clamp<std::size_t>(
+        std::thread::hardware_concurrency() /
+            std::max(config.islands, 1), 1, std::max<std::size_t>(
+                tasks.size(), 1));
+    LOG(info, "Running {} tasks on {} threads...", tasks.size(), threads);
+
+    std::atomic<std::size_t> next_task { 0 };
+    const auto worker = [&]() {
+        for(auto i = next_task++; i < tasks.size(); i = next_task++)
+        {
+            if(!keep_running()) return;
+            auto &task = tasks[i];
+            const auto checkpoint = checkpoint_path(task);
+            const auto row = performRandomizedTest(
+                config, task, keep_running, checkpoint);
+            if(row.empty())
+            {
+                LOG(info, "Test with {} nodes aborted.", task.node_amount);
+                return;
+            }
+            LOG(info, "{} nodes: graph {}, opti {}: {}",
+                task.node_amount, task.graph, task.repeat, row);
+            {
+                auto &file = files.at(task.node_amount);
+                std::lock_guard lock { file.mutex };
+                file.csv << row << std::endl;
+            }
+            // only dropped once the result is on disk
+            std::error_code ec;
+            std::filesystem::remove(checkpoint, ec);
+        }
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(threads);
+    for(std::size_t t = 0; t < threads; ++t)
+        pool.emplace_back(worker);
+    for(auto &&t : pool)
+        t.join();
+    LOG(info, "Finished randomized tests.");
+}
@@ -0,0 +1,118 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <functional>
+#include <filesystem>
+#include <random>
+
+#include <GraphLayout/Graph/NodeGraph.hpp>
+#include <GraphLayout/Genetic/StopCondition.hpp>
+
+namespace usagi
+{
+struct RandomTestConfig
+{
+    int start_node_amount = 4;
+    int finish_node_amount = 100;
+    int step = 1;
+    // # of randomly generated graph
+    int generation = 5;
+    // # of repeated optimization on each generated graph
+    int repeat = 5;
+    int population = 100;
+    float canvas_size_per_node = 250;
+    bool heuristic = true;
+    // stop evaluating offspring below the worst individual
+    bool bounded_evaluation = true;
+    // fraction of the initial population seeded from a force-directed
+    // layout, the rest is uniformly random
+    float seeded_fraction = 0;
+    // # of offspring pairs produced in parallel by each step
+    int batch_size = 1;
+    // # of populations evolved on separate threads
+    int islands = 1;
+    int migration_interval = 500;
+    int migration_size = 2;
+    bool fully_connected_migration = false;
+
+    int pin_amount = 5;
+    // # of edges / # of nodes
+    float pin_connection_rate = 2;
+
+    genetic::stop::SolutionConvergedStopCondition<float> stop;
+
+    // the seeds of all graphs and optimizations are derived from this one,
+    // so that a campaign can be reproduced.
+    std::uint32_t seed = 1;
+    // seconds between snapshots of each running optimization. 0 only saves
+    // them when the campaign is aborted.
+    float checkpoint_interval = 300;
+};
+
+/**
+ * \brief A single optimization of a randomized test campaign.
+ */
+struct RandomTestTask
+{
+    int node_amount = 0;
+    // which random graph of this node amount, and which optimization on it
+    int graph = 0;
+    int repeat = 0;
+    // the graph seed is shared by all repeats on the same graph
+    std::uint32_t graph_seed = 0;
+    std::uint32_t seed = 0;
+};
+
+/**
+ * \brief Replace the content of graph with node_amount nodes of a single
+ * 100x100 prototype having pin_amount input and output ports.
+ */
+void createTestNodes(
+    node_graph::NodeGraph &graph,
+    int node_amount,
+    int pin_amount);
+
+/**
+ * \brief Replace the links of a graph made by createTestNodes() with
+ * link_count links between random ports.
+ */
+void createRandomLinks(
+    node_graph::NodeGraph &graph,
+    int link_count,
+    std::mt19937 &rng);
+
+/**
+ * \brief List all optimizations of the campaign, largest graphs first.
+ */
+std::vector<RandomTestTask> planRandomizedTests(
+    const RandomTestConfig &config);
+
+/**
+ * \brief Generate the random graph of task and optimize it once. Returns the
+ * CSV line of the result, or an empty string if keep_running() returned
+ * false before the optimization finished. Unless checkpoint is empty, the
+ * optimization is resumed from that file if it exists, saved there every
+ * config.checkpoint_interval seconds and when aborted.
+ */
+std::string performRandomizedTest(
+    const RandomTestConfig &config,
+    const RandomTestTask &task,
+    const std::function<bool()> &keep_running,
+    const std::filesystem::path &checkpoint = { });
+
+/**
+ * \brief Run all tasks of the campaign on a thread pool, writing one line
+ * per task into test_<node amount>.csv in folder. The rows of a file are
+ * written in the order the tasks finish.
+ *
+ * Running optimizations are saved into folder/checkpoints. Running the same
+ * campaign on the same folder again skips the tasks already in the CSV
+ * files and resumes the saved ones.
+ */
+void performRandomizedTests(
+    const RandomTestConfig &config,
+    const std::filesystem::path &folder,
+    const std::function<bool()> &keep_running);
+}
@@ -0,0 +1,213 @@
+﻿#pragma once
+
+#include <array>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <algorithm>
+
+namespace usagi
+{
+/**
+ * \brief Quadtree (2D) or octree (3D) summarizing the mass distribution of
+ * a point set, used to approximate n-body forces in O(n log n).
+ * Based on:
+ * J. Barnes and P. Hut. A hierarchical O(N log N) force-calculation
+ * algorithm. Nature, 324:446-449, 1986.
+ *
+ * Every point has unit mass. The tree is rebuilt from scratch whenever the
+ * points move, reusing its buffers.
+ */
+template <
+    typename Vector,
+    typename VectorTraits,
+    int Dimension = Vector::RowsAtCompileTime
+>
+struct BarnesHutTree
+{
+    static_assert(Dimension >= 1 && Dimension <= 3);
+
+    static constexpr std::uint32_t CHILD_COUNT = 1u << Dimension;
+    // cells are not split deeper, coincident points end up in the same leaf
+    static constexpr int MAX_DEPTH = 24;
+
+    struct Cell
+    {
+        Vector center_of_mass;
+        // edge length of the cubic cell
+        float size = 0;
+        float mass = 0;
+        // range of the cell in order
+        std::uint32_t begin = 0, end = 0;
+        // index of the first of CHILD_COUNT children, 0 for leaves since the
+        // root is never a child
+        std::uint32_t children = 0;
+    };
+
+    std::vector<Cell> cells;
+    std::vector<Vector> points;
+    // point indices arranged so that each cell covers a contiguous range
+    std::vector<std::uint32_t> order;
+    // position of each point in order
+    std::vector<std::uint32_t> slots;
+
+    void build(const std::vector<Vector> &positions)
+    {
+        points = positions;
+        cells.clear();
+        const auto count = static_cast<std::uint32_t>(points.size());
+        order.resize(count);
+        for(std::uint32_t i = 0; i < count; ++i)
+            order[i] = i;
+        if(count == 0) return;
+
+        // cubic bounding box of all points
+        Vector lo = points[0], hi = points[0];
+        for(auto &&p : points)
+        {
+            for(int d = 0; d < Dimension; ++d)
+            {
+                lo[d] = std::min(lo[d], p[d]);
+                hi[d] = std::max(hi[d], p[d]);
+            }
+        }
+        float size = 0;
+        for(int d = 0; d < Dimension; ++d)
+            size = std::max(size, hi[d] - lo[d]);
+        // keep the points on the upper faces inside
+        size = std::max(size * 1.0001f, std::numeric_limits<float>::min());
+
+        Cell root;
+        VectorTraits().set_zeros(root.center_of_mass);
+        root.size = size;
+        root.begin = 0;
+        root.end = count;
+        cells.push_back(root);
+        scratch.resize(count);
+        split(0, lo, 0);
+
+        slots.resize(count);
+        for(std::uint32_t s = 0; s < count; ++s)
+            slots[order[s]] = s;
+    }
+
+    /**
+     * \brief Visit the mass distribution as seen from point i, which itself
+     * is excluded. func(position, mass) is invoked for the other points and
+     * for cells whose size over their distance to point i is below theta,
+     * which are replaced by their center of mass. Cells containing point i
+     * are always opened.
+     */
+    template <typename Func>
+    void visit(const std::size_t i, const float theta, Func &&func) const
+    {
+        if(cells.empty()) return;
+
+        const auto &p = points[i];
+        const auto slot = slots[i];
+        std::array<std::uint32_t, MAX_DEPTH * (CHILD_COUNT - 1) + 1> stack;
+        std::size_t top = 0;
+        stack[top++] = 0;
+        while(top)
+        {
+            const auto &c = cells[stack[--top]];
+            if(c.mass == 0) continue;
+            const bool contains = c.begin <= slot && slot < c.end;
+            if(!contains && c.size < theta *
+                VectorTraits().length(c.center_of_mass - p))
+            {
+                func(c.center_of_mass, c.mass);
+            }
+            else if(c.children == 0)
+            {
+                for(auto s = c.begin; s < c.end; ++s)
+                {
+                    if(s != slot)
+                        func(points[order[s]], 1.f);
+                }
+            }
+            else
+            {
+                for(std::uint32_t k = 0; k < CHILD_COUNT; ++k)
+                    stack[top++] = c.children + k;
+            }
+        }
+    }
+
+private:
+    std::vector<std::uint32_t> scratch;
+
+    void split(const std::uint32_t cell, const Vector &corner, const int depth)
+    {
+        const auto begin = cells[cell].begin;
+        const auto end = cells[cell].end;
+        const auto size = cells[cell].size;
+
+        if(end - begin <= 1 || depth == MAX_DEPTH)
+        {
+            Vector sum;
+            VectorTraits().set_zeros(sum);
+            for(auto s = begin; s < end; ++s)
+                sum += points[order[s]];
+            cells[cell].mass = static_cast<float>(end - begin);
+            cells[cell].center_of_mass = sum / cells[cell].mass;
+            return;
+        }
+
+        // sort the points into the children with a counting sort
+        const auto half = size * 0.5f;
+        const auto child_of = [&](const Vector &p) {
+            std::uint32_t k = 0;
+            for(int d = 0; d < Dimension; ++d)
+            {
+                if(p[d] >= corner[d] + half)
+                    k |= 1u << d;
+            }
+            return k;
+        };
+        std::array<std::uint32_t, CHILD_COUNT + 1> offsets { };
+        for(auto s = begin; s < end; ++s)
+            ++offsets[child_of(points[order[s]]) + 1];
+        for(std::uint32_t k = 0; k < CHILD_COUNT; ++k)
+            offsets[k + 1] += offsets[k];
+        auto fill = offsets;
+        for(auto s = begin; s < end; ++s)
+        {
+            const auto i = order[s];
+            scratch[begin + fill[child_of(points[i])]++] = i;
+        }
+        std::copy(scratch.begin() + begin, scratch.begin() + end,
+            order.begin() + begin);
+
+        const auto children = static_cast<std::uint32_t>(cells.size());
+        cells[cell].children = children;
+        for(std::uint32_t k = 0; k < CHILD_COUNT; ++k)
+        {
+            Cell c;
+            VectorTraits().set_zeros(c.center_of_mass);
+            c.size = half;
+            c.begin = begin + offsets[k];
+            c.end = begin + offsets[k + 1];
+            cells.push_back(c);
+        }
+
+        Vector sum;
+        VectorTraits().set_zeros(sum);
+        for(std::uint32_t k = 0; k < CHILD_COUNT; ++k)
+        {
+            const auto child = children + k;
+            if(cells[child].begin == cells[child].end) continue;
+            Vector child_corner = corner;
+            for(int d = 0; d < Dimension; ++d)
+            {
+                if(k & (1u << d))
+                    child_corner[d] += half;
+            }
+            split(child, child_corner, depth + 1);
+            sum += cells[child].center_of_mass * cells[child].mass;
+        }
+        cells[cell].mass = static_cast<float>(end - begin);
+        cells[cell].center_of_mass = sum / cells[cell].mass;
+    }
+};
+}
@@ -1,11 +1,63 @@
 ﻿#pragma once
 
 #include <cmath>
+#include <vector>
+#include <thread>
+#include <limits>
+#include <cstdint>
+#include <numeric>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <execution>
+#include <type_traits>
+
+#include "BarnesHutTree.hpp"
 
 namespace usagi
 {
 struct ForcePropertyTag;
 
+namespace detail
+{
+/**
+ * \brief Detects graph traits providing edge_begin(graph), edge_end(graph)
+ * and edge_vertices(graph, edge_iterator), the latter returning the pair of
+ * vertex iterators joined by the edge. Each undirected edge is expected to
+ * be enumerated once.
+ */
+template <typename Graph, typename GraphTraits, typename = void>
+struct HasEdgeIterator : std::false_type
+{
+};
+
+template <typename Graph, typename GraphTraits>
+struct HasEdgeIterator<Graph, GraphTraits, std::void_t<
+    decltype(std::declval<GraphTraits&>().edge_vertices(
+        std::declval<Graph*>(),
+        std::declval<GraphTraits&>().edge_begin(std::declval<Graph*>()))),
+    decltype(std::declval<GraphTraits&>().edge_end(std::declval<Graph*>()))
+>> : std::true_type
+{
+};
+
+/**
+ * \brief Detects property accessors storing one value per vertex ordinal in
+ * a contiguous std::vector<Value> named values, like DenseVertexProperty.
+ */
+template <typename Accessor, typename Value, typename = void>
+struct IsDenseProperty : std::false_type
+{
+};
+
+template <typename Accessor, typename Value>
+struct IsDenseProperty<Accessor, Value, std::enable_if_t<std::is_same_v<
+    decltype(std::declval<Accessor&>().values), std::vector<Value>
+>>> : std::true_type
+{
+};
+}
+
 /**
  * \brief Based on:
  * P. Eades. A heuristic for graph drawing.
@@ -50,8 +102,63 @@ struct SimpleSpring
         float c3 = 1;
         // update rate
         float c4 = 0.1f;
+        // approximate the repulsion with a Barnes-Hut tree
+        bool barnes_hut = false;
+        // opening angle: cells smaller than theta times their distance are
+        // treated as a single mass. 0 is exact.
+        float theta = 0.8f;
+        // adapt the update rate to the progress of the energy and limit
+        // the length each vertex may move by a decreasing temperature
+        bool adaptive_cooling = true;
+        // the update rate is multiplied by this factor when the energy
+        // rises, and divided by it after five iterations of decreasing
+        // energy
+        float cooling_factor = 0.9f;
+        // temperature of the first iteration, in units of c2
+        float initial_temperature = 1;
+        // the temperature decays by this factor in each iteration, so that
+        // layouts without an equilibrium freeze as well, e.g. disconnected
+        // components pushing each other away
+        float annealing = 0.99f;
+        // converged once c4 * force is below tolerance * c2 on all vertices
+        float tolerance = 1e-2f;
     } *param = nullptr;
 
+    /**
+     * \brief Based on the adaptive step length of:
+     * Y. Hu. Efficient, high-quality force-directed graph drawing.
+     * Mathematica Journal, 10(1):37-71, 2005.
+     */
+    struct Cooling
+    {
+        std::uint32_t iteration = 0;
+        // multiplies the update rate c4
+        float gain = 1;
+        // longest move allowed
+        float temperature = 0;
+        int progress = 0;
+        // sum of the squared forces
+        double energy = 0;
+        double last_energy = std::numeric_limits<double>::infinity();
+        // longest move of a vertex in the last iteration
+        float max_displacement = 0;
+        // longest c4 * force, the move without cooling
+        float max_force_displacement = 0;
+        bool converged = false;
+    } cooling;
+
+    BarnesHutTree<vector_t, vector_traits_t> tree;
+    std::vector<vector_t> positions;
+    // forces by vertex ordinal, unless the accessor stores them densely
+    std::vector<vector_t> force_storage;
+    // vertex ordinals joined by each edge
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> edges;
+    // one bit per vertex pair, rows padded to whole words
+    std::vector<std::uint64_t> adjacency;
+    std::size_t adjacency_words = 0;
+    // force accumulated by each thread, summed after each pass
+    std::vector<std::vector<vector_t>> thread_forces;
+
     SimpleSpring() = default;
 
     SimpleSpring(
@@ -62,6 +169,20 @@ struct SimpleSpring
     {
     }
 
+    /**
+     * \brief Start cooling again, e.g. after the graph or the parameters
+     * changed.
+     */
+    void restart()
+    {
+        cooling = { };
+    }
+
+    bool converged() const
+    {
+        return cooling.converged;
+    }
+
     // single update iteration
     void update()
     {
@@ -69,57 +190,329 @@ struct SimpleSpring
         // Input: Graph G
         // Output: Straight-line drawing of G
 
-        auto i = mTraits.vertex_begin(mGraph);
-        auto end = mTraits.vertex_end(mGraph);
+        gatherVertices();
+        gatherEdges();
 
         // calculate the force acting on each vertex
-        for(; i != end; ++i)
+        if(param->barnes_hut)
         {
-            // each vertex is affected by all other vertices
-            vector_t force;
-            vector_traits_t().set_zeros(force);
-            auto other_i = mTraits.vertex_begin(mGraph);
-            auto other_end = mTraits.vertex_end(mGraph);
-            for(; other_i != other_end; ++other_i)
+            repelBarnesHut();
+            // the tree also repelled the adjacent pairs, take that out
+            attract(true);
+        }
+        else
+        {
+            buildAdjacency();
+            repel();
+            attract(false);
+        }
+
+        // move the vertex c4 ∗ (force on vertex);
+        if(cooling.iteration++ == 0)
+            cooling.temperature = param->initial_temperature * param->c2;
+        const auto rate = param->adaptive_cooling
+            ? param->c4 * cooling.gain
+            : param->c4;
+        auto &forces = forceBuffer();
+        cooling.energy = 0;
+        cooling.max_displacement = 0;
+        cooling.max_force_displacement = 0;
+        std::size_t k = 0;
+        auto end = mTraits.vertex_end(mGraph);
+        for(auto i = mTraits.vertex_begin(mGraph); i != end; ++i, ++k)
+        {
+            if constexpr(!dense_forces)
+                force_accessor(i) = forces[k];
+            const auto f = vector_traits_t().length(forces[k]);
+            cooling.energy += double(f) * f;
+            cooling.max_force_displacement =
+                std::max(cooling.max_force_displacement, param->c4 * f);
+            auto scale = rate;
+            if(param->adaptive_cooling && rate * f > cooling.temperature)
+                scale = cooling.temperature / f;
+            mTraits.position(i) += scale * forces[k];
+            cooling.max_displacement =
+                std::max(cooling.max_displacement, scale * f);
+        }
+        // the forces are in balance, or the layout is frozen
+        const auto tolerance = param->tolerance * param->c2;
+        cooling.converged = cooling.max_force_displacement < tolerance;
+        if(param->adaptive_cooling)
+        {
+            cool();
+            cooling.converged = cooling.converged ||
+                cooling.temperature < tolerance;
+        }
+
+        // draw a filled circle for each vertex;
+        // draw a straight-line segment for each edge;
+    }
+
+    void cool()
+    {
+        if(cooling.energy < cooling.last_energy)
+        {
+            if(++cooling.progress >= 5)
             {
-                if(i == other_i) continue;
+                cooling.progress = 0;
+                cooling.gain /= param->cooling_factor;
+            }
+        }
+        else
+        {
+            cooling.progress = 0;
+            cooling.gain *= param->cooling_factor;
+        }
+        // keep the gain finite on long runs, the temperature limits the
+        // moves anyway
+        cooling.gain = std::clamp(cooling.gain, 1e-3f, 1e3f);
+        cooling.last_energy = cooling.energy;
+        cooling.temperature *= param->annealing;
+    }
 
-                auto &&p0 = mTraits.position(i);
-                auto &&p1 = mTraits.position(other_i);
-                // attractive force direction
-                const auto dist = p1 - p0;
-                const auto dir = vector_traits_t().normalized(dist);
-                const auto l = vector_traits_t().length(dist);
-                assert(l > 0);
+    static constexpr bool dense_forces =
+        detail::IsDenseProperty<ForceAccessor, vector_t>::value;
 
-                // adjacent: edge = logarithmic springs
-                if(mTraits.is_adjacent(mGraph, i, other_i))
-                {
-                    // log(x) > 0 when x > 1 and < 0 when 0 < x < 1.
-                    // therefore, when l (real spring length is longer than
-                    // c2 (steady spring length, the force is attractive.
-                    // otherwise it is repulsive.
-                    force += dir * param->c1 * std::log(l / param->c2);
-                }
-                // nonadjacent: repulsive force (always)
-                else
+    /**
+     * \brief The forces are accumulated directly in the property storage
+     * when it is dense. Otherwise they are copied to the accessor after each
+     * iteration.
+     */
+    std::vector<vector_t> & forceBuffer()
+    {
+        if constexpr(dense_forces)
+            return force_accessor.values;
+        else
+            return force_storage;
+    }
+
+    void gatherVertices()
+    {
+        positions.clear();
+        auto end = mTraits.vertex_end(mGraph);
+        for(auto i = mTraits.vertex_begin(mGraph); i != end; ++i)
+            positions.push_back(mTraits.position(i));
+        forceBuffer().resize(positions.size());
+    }
+
+    /**
+     * \brief Collect the edges as pairs of vertex ordinals. Uses the edge
+     * iterator of the traits when available, otherwise the adjacency of
+     * each vertex pair is tested once.
+     */
+    void gatherEdges()
+    {
+        edges.clear();
+        const auto begin = mTraits.vertex_begin(mGraph);
+        const auto end = mTraits.vertex_end(mGraph);
+        if constexpr(detail::HasEdgeIterator<Graph, GraphTraits>::value)
+        {
+            auto e = mTraits.edge_begin(mGraph);
+            const auto e_end = mTraits.edge_end(mGraph);
+            for(; e != e_end; ++e)
+            {
+                auto [a, b] = mTraits.edge_vertices(mGraph, e);
+                edges.emplace_back(
+                    static_cast<std::uint32_t>(std::distance(begin, a)),
+                    static_cast<std::uint32_t>(std::distance(begin, b)));
+            }
+        }
+        else
+        {
+            std::uint32_t a = 0;
+            for(auto i = begin; i != end; ++i, ++a)
+            {
+                auto other_i = std::next(i);
+                for(auto b = a + 1; other_i != end; ++other_i, ++b)
                 {
-                    force -= dir * param->c3 / std::sqrt(l);
+                    if(mTraits.is_adjacent(mGraph, i, other_i))
+                        edges.emplace_back(a, b);
                 }
             }
-            force_accessor(i) = force;
         }
+    }
 
-        // move the vertex c4 ∗ (force on vertex);
-        i = mTraits.vertex_begin(mGraph);
-        for(; i != end; ++i)
+    void buildAdjacency()
+    {
+        const auto n = positions.size();
+        adjacency_words = (n + 63) / 64;
+        adjacency.assign(n * adjacency_words, 0);
+        for(auto &&[a, b] : edges)
         {
-            auto &&p = mTraits.position(i);
-            p += param->c4 * force_accessor(i);
+            adjacency[a * adjacency_words + b / 64] |= 1ull << (b % 64);
+            adjacency[b * adjacency_words + a / 64] |= 1ull << (a % 64);
         }
+    }
 
-        // draw a filled circle for each vertex;
-        // draw a straight-line segment for each edge;
+    bool adjacent(const std::size_t a, const std::size_t b) const
+    {
+        return adjacency[a * adjacency_words + b / 64] >> (b % 64) & 1;
+    }
+
+    /**
+     * \brief Invoke func(forces, begin, end) on [0, count) split into
+     * chunks at the given bounds, in parallel. Each chunk accumulates into
+     * its own zeroed force buffer. The buffers are summed into forces in
+     * chunk order afterwards, so the result doesn't depend on scheduling.
+     */
+    template <typename Func>
+    void parallelForChunks(
+        const std::vector<std::size_t> &bounds,
+        Func &&func)
+    {
+        const auto chunk_count = bounds.size() - 1;
+        thread_forces.resize(chunk_count);
+        std::vector<std::size_t> chunks(chunk_count);
+        std::iota(chunks.begin(), chunks.end(), 0);
+        std::for_each(
+            std::execution::par,
+            chunks.begin(), chunks.end(),
+            [&](const std::size_t c) {
+                auto &buffer = thread_forces[c];
+                buffer.resize(positions.size());
+                for(auto &&f : buffer)
+                    vector_traits_t().set_zeros(f);
+                func(buffer, bounds[c], bounds[c + 1]);
+            });
+        auto &forces = forceBuffer();
+        for(auto &&buffer : thread_forces)
+        {
+            for(std::size_t k = 0; k < forces.size(); ++k)
+                forces[k] += buffer[k];
+        }
+    }
+
+    static std::size_t threadCount(const std::size_t work)
+    {
+        return std::clamp<std::size_t>(
+            std::thread::hardware_concurrency(), 1,
+            std::max<std::size_t>(work, 1));
+    }
+
+    /**
+     * \brief Repulsion between all nonadjacent pairs, each pair evaluated
+     * once. Rows of the pair triangle are split so that each thread gets
+     * about the same number of pairs.
+     */
+    void repel()
+    {
+        const auto n = positions.size();
+        for(auto &&f : forceBuffer())
+            vector_traits_t().set_zeros(f);
+
+        const auto threads = threadCount(n / 64);
+        const auto total = n * (n - 1) / 2;
+        std::vector<std::size_t> bounds { 0 };
+        std::size_t pairs = 0;
+        for(std::size_t i = 0; i < n; ++i)
+        {
+            pairs += n - 1 - i;
+            if(pairs * threads >= total * bounds.size() &&
+                bounds.size() < threads)
+                bounds.push_back(i + 1);
+        }
+        bounds.push_back(n);
+
+        parallelForChunks(bounds, [this, n](
+            std::vector<vector_t> &buffer,
+            const std::size_t begin,
+            const std::size_t end) {
+            for(auto i = begin; i < end; ++i)
+            {
+                const auto &p0 = positions[i];
+                vector_t force;
+                vector_traits_t().set_zeros(force);
+                for(auto j = i + 1; j < n; ++j)
+                {
+                    // adjacent: logarithmic springs, see attract()
+                    if(adjacent(i, j)) continue;
+
+                    const auto dist = positions[j] - p0;
+                    const auto dir = vector_traits_t().normalized(dist);
+                    const auto l = vector_traits_t().length(dist);
+                    assert(l > 0);
+
+                    // nonadjacent: repulsive force (always)
+                    const auto f = dir * (param->c3 / std::sqrt(l));
+                    force -= f;
+                    buffer[j] += f;
+                }
+                buffer[i] += force;
+            }
+        });
+    }
+
+    /**
+     * \brief Approximate the repulsion between all pairs with a tree rebuilt
+     * in each iteration. Each vertex only writes its own force, so no
+     * buffers are needed.
+     */
+    void repelBarnesHut()
+    {
+        tree.build(positions);
+
+        auto &forces = forceBuffer();
+        const auto n = positions.size();
+        const auto threads = threadCount(n / 64);
+        std::vector<std::size_t> chunks(threads);
+        std::iota(chunks.begin(), chunks.end(), 0);
+        std::for_each(
+            std::execution::par,
+            chunks.begin(), chunks.end(),
+            [&](const std::size_t c) {
+                for(auto k = n * c / threads; k < n * (c + 1) / threads; ++k)
+                {
+                    auto &force = forces[k];
+                    vector_traits_t().set_zeros(force);
+                    const auto &p0 = positions[k];
+                    tree.visit(k, param->theta,
+                        [&](const vector_t &p1, const float mass) {
+                            const auto dist = p1 - p0;
+                            const auto l = vector_traits_t().length(dist);
+                            if(l <= 0) return;
+                            force -= dist / l *
+                                (mass * param->c3 / std::sqrt(l));
+                        });
+                }
+            });
+    }
+
+    /**
+     * \brief Apply the springs along the edges, each edge visited once.
+     * When cancel_repulsion is set, the repulsion between the two ends is
+     * taken out, for when the repulsion pass didn't skip adjacent pairs.
+     */
+    void attract(const bool cancel_repulsion)
+    {
+        const auto threads = threadCount(edges.size() / 1024);
+        std::vector<std::size_t> bounds(threads + 1);
+        for(std::size_t c = 0; c <= threads; ++c)
+            bounds[c] = edges.size() * c / threads;
+
+        parallelForChunks(bounds, [this, cancel_repulsion](
+            std::vector<vector_t> &buffer,
+            const std::size_t begin,
+            const std::size_t end) {
+            for(auto e = begin; e < end; ++e)
+            {
+                const auto [a, b] = edges[e];
+                const auto dist = positions[b] - positions[a];
+                const auto dir = vector_traits_t().normalized(dist);
+                const auto l = vector_traits_t().length(dist);
+                assert(l > 0);
+
+                // log(x) > 0 when x > 1 and < 0 when 0 < x < 1.
+                // therefore, when l (real spring length is longer than
+                // c2 (steady spring length, the force is attractive.
+                // otherwise it is repulsive.
+                auto magnitude = param->c1 * std::log(l / param->c2);
+                if(cancel_repulsion)
+                    magnitude += param->c3 / std::sqrt(l);
+                const auto f = dir * magnitude;
+                buffer[a] += f;
+                buffer[b] -= f;
+            }
+        });
     }
 };
 }
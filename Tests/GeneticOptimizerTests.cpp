@@ -0,0 +1,164 @@
+﻿#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <random>
+#include <limits>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#include <GraphLayout/Genetic/GeneticOptimizer.hpp>
+#include <GraphLayout/Genetic/ParentSelection.hpp>
+#include <GraphLayout/Genetic/Crossover.hpp>
+#include <GraphLayout/Genetic/Mutation.hpp>
+#include <GraphLayout/Genetic/Replacement.hpp>
+#include <GraphLayout/Genetic/StopCondition.hpp>
+
+using namespace usagi;
+using namespace genetic;
+
+/*
+ * Checks the bookkeeping of GeneticOptimizer on a small real-valued problem.
+ * Exits with a non-zero status if any check fails.
+ */
+namespace
+{
+using Genotype = std::vector<float>;
+using TestIndividual = Individual<Genotype, float>;
+
+struct SphereFitness
+{
+    using FitnessT = float;
+
+    float operator()(TestIndividual &individual) const
+    {
+        float f = 0;
+        for(auto &&g : individual.genotype)
+            f -= g * g;
+        return f;
+    }
+};
+
+struct UniformGenerator
+{
+    std::uniform_real_distribution<float> domain { -10, 10 };
+    std::size_t genes = 8;
+
+    template <typename Optimizer>
+    TestIndividual operator()(Optimizer &o)
+    {
+        TestIndividual individual;
+        individual.genotype.resize(genes);
+        std::generate(individual.genotype.begin(), individual.genotype.end(),
+            std::bind(domain, std::ref(o.rng)));
+        return individual;
+    }
+};
+
+template <typename Replacement>
+using TestOptimizer = GeneticOptimizer<
+    float,
+    SphereFitness,
+    parent::TournamentParentSelection<5, 2>,
+    crossover::WholeArithmeticRecombination,
+    mutation::UniformRealMutation<Genotype>,
+    Replacement,
+    stop::SolutionConvergedStopCondition<float>,
+    UniformGenerator
+>;
+
+int failures = 0;
+
+void check(const bool condition, const char *what, const std::size_t step)
+{
+    if(condition) return;
+    std::cerr << "FAILED at step " << step << ": " << what << "\n";
+    ++failures;
+}
+
+template <typename Optimizer>
+void checkHeaps(Optimizer &o, const std::size_t step)
+{
+    check(o.best.valid(), "best heap order", step);
+    check(o.worst.valid(), "worst heap order", step);
+    check(o.oldest.valid(), "oldest heap order", step);
+
+    const auto [min, max] = std::minmax_element(
+        o.population.begin(), o.population.end(),
+        [](auto &&a, auto &&b) { return a.fitness < b.fitness; });
+    check(o.best.top()->fitness == max->fitness, "best.top()", step);
+    check(o.worst.top()->fitness == min->fitness, "worst.top()", step);
+}
+
+template <typename Optimizer>
+void setUp(Optimizer &o, const std::uint32_t seed)
+{
+    o.rng.seed(seed);
+    o.mutation.domain = o.generator.domain;
+    o.batch_size = 8;
+    o.initializePopulation(64);
+}
+
+/**
+ * \brief The heaps must be intact after every batched step, since the
+ * replacement strategies and the evaluation bound read their tops.
+ */
+void testBatchHeaps()
+{
+    TestOptimizer<replacement::IncrementalTournamentReplacement<10, 2>> o;
+    setUp(o, 1);
+    checkHeaps(o, 0);
+    for(std::size_t step = 1; step <= 2000; ++step)
+    {
+        o.step();
+        checkHeaps(o, step);
+    }
+}
+
+/**
+ * \brief With batch_size > 1, ReplaceWorst must choose the worst
+ * individuals of the population.
+ */
+void testBatchReplaceWorst()
+{
+    TestOptimizer<replacement::ReplaceWorst> o;
+    setUp(o, 2);
+    std::vector<std::size_t> chosen;
+    std::vector<std::uint8_t> marks;
+    for(std::size_t step = 1; step <= 2000; ++step)
+    {
+        const auto count = o.batch_size * 2;
+        o.replacement(o, count, chosen);
+        marks.assign(o.population.size(), 0);
+        auto highest = std::numeric_limits<float>::lowest();
+        for(auto &&i : chosen)
+        {
+            marks[i] = 1;
+            highest = std::max(highest, o.population[i].fitness);
+        }
+        bool worst = true;
+        for(std::size_t i = 0; i < o.population.size(); ++i)
+        {
+            if(!marks[i] && o.population[i].fitness < highest)
+                worst = false;
+        }
+        check(worst, "ReplaceWorst chose a better individual", step);
+
+        o.step();
+        checkHeaps(o, step);
+    }
+}
+}
+
+int main()
+{
+    testBatchHeaps();
+    testBatchReplaceWorst();
+    if(failures)
+    {
+        std::cerr << failures << " checks failed\n";
+        return EXIT_FAILURE;
+    }
+    std::cout << "All checks passed\n";
+    return EXIT_SUCCESS;
+}